@@ -0,0 +1,45 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_BENCH_H
+#define AVR_CAN_USB_BENCH_H
+
+/*
+ * Protocol between the bench firmware and the simavr runner. The firmware
+ * writes markers to the general purpose I/O registers, which cost one OUT
+ * instruction and are otherwise unused:
+ *
+ *   GPIOR0: bit 7 clear opens, bit 7 set closes the window of a BENCH_ID;
+ *           the runner reads the cycle counter at both writes, windows of
+ *           different ids may nest
+ *   GPIOR1: index of the S command bitrate the following samples belong to
+ *   GPIOR2: BENCH_INJECT puts a frame on the bus of the simulated MCP2515
+ */
+enum BENCH_ID {
+    BENCH_READ_RX = 1,       /* readMessageThroughRXBn() */
+    BENCH_CREATE_TRANSMIT,   /* canhacker_createTransmit() */
+    BENCH_PARSE_TRANSMIT,    /* canhacker_parseTransmit() */
+    BENCH_RX_FRAME,          /* bus frame to bytes in the USART ring, flush included */
+    BENCH_TX_FRAME,          /* transmit command to frame on the bus */
+    BENCH_RX_FLUSH,          /* flushReceiveCan() of one frame, inside BENCH_RX_FRAME */
+    BENCH_DONE,
+    BENCH_IDS
+};
+
+#define BENCH_END_FLAG 0x80
+#define BENCH_INJECT 0x01
+
+// data space addresses of GPIOR0..2 on the atmega644 family
+#define BENCH_GPIOR0_ADDRESS 0x3E
+#define BENCH_GPIOR1_ADDRESS 0x4A
+#define BENCH_GPIOR2_ADDRESS 0x4B
+
+#ifdef __AVR__
+#define BENCH_BEGIN(id) (GPIOR0 = (id))
+#define BENCH_END(id) (GPIOR0 = BENCH_END_FLAG | (id))
+#define BENCH_BITRATE(index) (GPIOR1 = (index))
+#define BENCH_INJECT_FRAME() (GPIOR2 = BENCH_INJECT)
+#endif
+
+#endif //AVR_CAN_USB_BENCH_H
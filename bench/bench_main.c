@@ -0,0 +1,121 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include <atmel_start.h>
+#include <canhacker.h>
+#include <string.h>
+#include "bench.h"
+
+/*
+ * Firmware variant for simavr/avr-can-usb-simavr. It runs the frame hot
+ * paths BENCH_ROUNDS times at every S command bitrate and brackets each
+ * one with GPIOR0 markers; the runner turns them into cycle counts.
+ * Everything that is not measured, draining the USART for one, happens
+ * outside the markers.
+ */
+#define BENCH_ROUNDS 32
+
+static const char transmitCommand[] = "t12381122334455667788";
+
+static int usart_putchar(char c, FILE *stream)
+{
+	USART_0_write(c);
+	return 0;
+}
+
+static FILE usart_stream = FDEV_SETUP_STREAM(usart_putchar, NULL, _FDEV_SETUP_WRITE);
+
+static void bench_command(const char *command)
+{
+	receiveCommand(command, strlen(command));
+	USART_0_flush();
+}
+
+static void bench_readRx(void)
+{
+	struct can_frame frame;
+
+	/* keep ISR(PCINT1_vect) away from the frame */
+	uint8_t held = holdInterrupt();
+	BENCH_INJECT_FRAME();
+	BENCH_BEGIN(BENCH_READ_RX);
+	readMessageThroughRXBn(RXB0, &frame);
+	BENCH_END(BENCH_READ_RX);
+	PCIFR = (1 << PCIF1);
+	releaseInterrupt(held);
+}
+
+static void bench_createTransmit(void)
+{
+	struct can_frame frame = {.can_id = 0x123, .can_dlc = 8, .data = {1, 2, 3, 4, 5, 6, 7, 8}};
+	char buffer[36];
+
+	BENCH_BEGIN(BENCH_CREATE_TRANSMIT);
+	canhacker_benchCreateTransmit(&frame, buffer, sizeof buffer);
+	BENCH_END(BENCH_CREATE_TRANSMIT);
+}
+
+static void bench_parseTransmit(void)
+{
+	struct can_frame frame;
+
+	BENCH_BEGIN(BENCH_PARSE_TRANSMIT);
+	canhacker_benchParseTransmit(transmitCommand, sizeof transmitCommand - 1, &frame);
+	BENCH_END(BENCH_PARSE_TRANSMIT);
+}
+
+/*
+ * One frame from the bus to the USART ring. Batched output only leaves
+ * on flushReceiveCan(), so the flush is inside the window and also timed
+ * on its own; rxFrame minus rxFlush is what a frame costs while batched.
+ */
+static void bench_rxFrame(void)
+{
+	BENCH_BEGIN(BENCH_RX_FRAME);
+	BENCH_INJECT_FRAME();
+	pollReceiveCan();
+	BENCH_BEGIN(BENCH_RX_FLUSH);
+	flushReceiveCan();
+	BENCH_END(BENCH_RX_FLUSH);
+	BENCH_END(BENCH_RX_FRAME);
+	USART_0_flush();
+}
+
+static void bench_txFrame(void)
+{
+	BENCH_BEGIN(BENCH_TX_FRAME);
+	receiveCommand(transmitCommand, sizeof transmitCommand - 1);
+	BENCH_END(BENCH_TX_FRAME);
+	USART_0_flush();
+}
+
+int main(void)
+{
+	atmel_start_init();
+
+	CanHacker(&usart_stream, NULL);
+	setBlockWriter(USART_0_write_block);
+	sei();
+
+	for (uint8_t bitrate = 0; bitrate <= 8; bitrate++) {
+		char command[] = {'S', '0' + bitrate, '\0'};
+		bench_command(command);
+		bench_command("Z1");
+		bench_command("O");
+		BENCH_BITRATE(bitrate);
+		for (uint8_t i = 0; i < BENCH_ROUNDS; i++) {
+			bench_readRx();
+			bench_createTransmit();
+			bench_parseTransmit();
+			bench_rxFrame();
+			bench_txFrame();
+		}
+		bench_command("C");
+	}
+	BENCH_BEGIN(BENCH_DONE);
+
+	cli();
+	while (1) {
+	}
+}
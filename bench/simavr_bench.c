@@ -0,0 +1,209 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+/*
+ * Runs the bench firmware (avr-can-usb-bench.elf) under simavr with the
+ * MCP2515 model of the host build as SPI peer and a counting UART sink,
+ * and prints the cycles between the GPIOR0 markers, see bench.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <avr_ioport.h>
+#include <avr_spi.h>
+#include <avr_uart.h>
+#include "bench.h"
+#include "mcp2515_sim.h"
+
+#define BENCH_F_CPU 14745600UL
+// standard data frame with 8 bytes, without stuff bits
+#define BENCH_FRAME_BITS 111
+
+struct bench_sample {
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+    uint32_t count;
+};
+
+static const uint32_t bitrates[] = {10000, 20000, 50000, 100000, 125000, 250000, 500000, 800000, 1000000};
+
+static const char *const names[BENCH_IDS] = {
+    [BENCH_READ_RX] = "readRx",
+    [BENCH_CREATE_TRANSMIT] = "createTx",
+    [BENCH_PARSE_TRANSMIT] = "parseTx",
+    [BENCH_RX_FRAME] = "rxFrame",
+    [BENCH_TX_FRAME] = "txFrame",
+    [BENCH_RX_FLUSH] = "rxFlush"
+};
+
+static avr_t *avr;
+static avr_irq_t *spiInput;
+static avr_irq_t *intPin;
+static avr_irq_t *rx0bfPin;
+static avr_irq_t *rx1bfPin;
+static avr_cycle_count_t opened[BENCH_IDS];
+static struct bench_sample samples[BENCH_IDS];
+static int bitrate = -1;
+static uint32_t uartBytes;
+static int done;
+
+static void bench_updateInt(void) {
+    avr_raise_irq(intPin, sim_intAsserted() ? 0 : 1);
+    avr_raise_irq(rx0bfPin, sim_rxBufferFull(0) ? 0 : 1);
+    avr_raise_irq(rx1bfPin, sim_rxBufferFull(1) ? 0 : 1);
+}
+
+static void bench_spiOutput(struct avr_irq_t *irq, uint32_t value, void *param) {
+    avr_raise_irq(spiInput, SPI_0_exchange_byte_polled((uint8_t) value));
+}
+
+static void bench_chipSelect(struct avr_irq_t *irq, uint32_t value, void *param) {
+    SS_set_level(value != 0);
+    bench_updateInt();
+}
+
+static void bench_rtsPin(struct avr_irq_t *irq, uint32_t value, void *param) {
+    /* TX0RTS is PA2, TX1RTS PA1, TX2RTS PA0 */
+    switch ((intptr_t) param) {
+        case 0:
+            TX2RTS_set_level(value != 0);
+            break;
+        case 1:
+            TX1RTS_set_level(value != 0);
+            break;
+        default:
+            TX0RTS_set_level(value != 0);
+            break;
+    }
+    bench_updateInt();
+}
+
+static void bench_uartOutput(struct avr_irq_t *irq, uint32_t value, void *param) {
+    uartBytes++;
+}
+
+static void bench_print(void) {
+    if (bitrate < 0) {
+        return;
+    }
+    double frameCycles = (double) BENCH_F_CPU * BENCH_FRAME_BITS / bitrates[bitrate];
+    printf("%7lu bit/s", (unsigned long) bitrates[bitrate]);
+    for (int id = BENCH_READ_RX; id < BENCH_DONE; id++) {
+        struct bench_sample *s = &samples[id];
+        if (s->count == 0) {
+            continue;
+        }
+        printf("  %s %lu..%lu avg %.0f", names[id], (unsigned long) s->min, (unsigned long) s->max,
+               (double) s->total / s->count);
+    }
+    /* share of the CPU a fully loaded bus takes on the receive path */
+    if (samples[BENCH_RX_FRAME].count != 0) {
+        printf("  rx load %.1f%%",
+               100.0 * samples[BENCH_RX_FRAME].total / samples[BENCH_RX_FRAME].count / frameCycles);
+    }
+    printf("\n");
+    memset(samples, 0, sizeof samples);
+}
+
+static void bench_marker(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param) {
+    uint8_t id = v & ~BENCH_END_FLAG;
+    avr->data[addr] = v;
+    if (id == BENCH_DONE) {
+        bench_print();
+        done = 1;
+        return;
+    }
+    if (id == 0 || id >= BENCH_IDS) {
+        return;
+    }
+    if (!(v & BENCH_END_FLAG)) {
+        opened[id] = avr->cycle;
+        return;
+    }
+    uint32_t cycles = (uint32_t) (avr->cycle - opened[id]);
+    struct bench_sample *s = &samples[id];
+    if (s->count == 0 || cycles < s->min) {
+        s->min = cycles;
+    }
+    if (cycles > s->max) {
+        s->max = cycles;
+    }
+    s->total += cycles;
+    s->count++;
+}
+
+static void bench_bitrate(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param) {
+    avr->data[addr] = v;
+    bench_print();
+    bitrate = v < sizeof bitrates / sizeof bitrates[0] ? v : -1;
+}
+
+static void bench_inject(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param) {
+    static uint8_t sequence;
+    struct can_frame frame = {.can_id = 0x123, .can_dlc = 8, .data = {0, 2, 3, 4, 5, 6, 7, 8}};
+    avr->data[addr] = v;
+    if (v == BENCH_INJECT) {
+        frame.data[0] = sequence++;
+        sim_inject(&frame);
+        bench_updateInt();
+    }
+}
+
+int main(int argc, char **argv) {
+    elf_firmware_t firmware;
+    const char *mcu = argc > 2 ? argv[2] : "atmega644";
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s avr-can-usb-bench.elf [mcu]\n", argv[0]);
+        return 2;
+    }
+    memset(&firmware, 0, sizeof firmware);
+    if (elf_read_firmware(argv[1], &firmware) != 0) {
+        fprintf(stderr, "cannot load %s\n", argv[1]);
+        return 1;
+    }
+    avr = avr_make_mcu_by_name(mcu);
+    if (avr == NULL) {
+        fprintf(stderr, "simavr does not know %s\n", mcu);
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = BENCH_F_CPU;
+
+    sim_reset();
+    spiInput = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), bench_spiOutput, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 4), bench_chipSelect, NULL);
+    for (intptr_t pin = 0; pin < 3; pin++) {
+        avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('A'), pin), bench_rtsPin, (void *) pin);
+    }
+    intPin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 2);
+    /* RX0BF is PB1, RX1BF PB0 */
+    rx0bfPin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 1);
+    rx1bfPin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0);
+    bench_updateInt();
+
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), bench_uartOutput, NULL);
+
+    avr_register_io_write(avr, BENCH_GPIOR0_ADDRESS, bench_marker, NULL);
+    avr_register_io_write(avr, BENCH_GPIOR1_ADDRESS, bench_bitrate, NULL);
+    avr_register_io_write(avr, BENCH_GPIOR2_ADDRESS, bench_inject, NULL);
+
+    int state = cpu_Running;
+    while (!done && state != cpu_Done && state != cpu_Crashed) {
+        state = avr_run(avr);
+    }
+    printf("%lu cycles, %lu UART bytes, %lu SPI bytes\n", (unsigned long) avr->cycle,
+           (unsigned long) uartBytes, (unsigned long) sim_getStats()->spiBytes);
+    return done ? 0 : 1;
+}
@@ -0,0 +1,14 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_ATOMIC_H
+#define AVR_CAN_USB_HOST_ATOMIC_H
+
+// single threaded on the host, interrupts are run from the main loop
+#define ENTER_CRITICAL(UNUSED) do {} while (0)
+#define EXIT_CRITICAL(UNUSED) do {} while (0)
+#define DISABLE_INTERRUPTS() do {} while (0)
+#define ENABLE_INTERRUPTS() do {} while (0)
+
+#endif //AVR_CAN_USB_HOST_ATOMIC_H
@@ -0,0 +1,13 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_AVR_INTERRUPT_H
+#define AVR_CAN_USB_HOST_AVR_INTERRUPT_H
+
+// the host runs the interrupt handlers synchronously, see host_serviceInterrupts()
+#define ISR(vector, ...) void vector(void)
+#define sei() ((void) 0)
+#define cli() ((void) 0)
+
+#endif //AVR_CAN_USB_HOST_AVR_INTERRUPT_H
@@ -0,0 +1,40 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_AVR_IO_H
+#define AVR_CAN_USB_HOST_AVR_IO_H
+
+#include <stdint.h>
+
+/*
+ * Registers the firmware headers touch, as plain variables defined in
+ * hal.c. Only the bit positions that are used are listed.
+ */
+extern volatile uint8_t PRR0;
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t PORTA, PORTB, PORTC, PORTD;
+extern volatile uint8_t DDRA, DDRB, DDRC, DDRD;
+extern volatile uint8_t PINA, PINB, PINC, PIND;
+
+#define PRADC 0
+#define PRUSART0 1
+#define PRSPI 2
+#define PRTIM1 3
+#define PRUSART1 4
+#define PRTIM0 5
+#define PRTIM2 6
+#define PRTWI 7
+
+#define PCIE1 1
+#define PCIF1 1
+
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+#define _BV(bit) (1 << (bit))
+
+#endif //AVR_CAN_USB_HOST_AVR_IO_H
@@ -0,0 +1,23 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_AVR_PGMSPACE_H
+#define AVR_CAN_USB_HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// one address space on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char *
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+#define pgm_read_dword(address) (*(const uint32_t *) (address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define fputs_P fputs
+
+#endif //AVR_CAN_USB_HOST_AVR_PGMSPACE_H
@@ -0,0 +1,26 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_DRIVER_INIT_H
+#define AVR_CAN_USB_HOST_DRIVER_INIT_H
+
+#include <compiler.h>
+#include <port.h>
+#include <spi_basic.h>
+
+/*
+ * The pins the MCP2515 driver uses, wired to the simulator instead of the
+ * port registers so it sees chip select and TXnRTS edges and drives INT
+ * and RXnBF.
+ */
+void SS_set_dir(const enum port_dir dir);
+void SS_set_level(const bool level);
+void TX0RTS_set_level(const bool level);
+void TX1RTS_set_level(const bool level);
+void TX2RTS_set_level(const bool level);
+bool INT_get_level(void);
+bool RX0BF_get_level(void);
+bool RX1BF_get_level(void);
+
+#endif //AVR_CAN_USB_HOST_DRIVER_INIT_H
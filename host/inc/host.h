@@ -0,0 +1,21 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_H
+#define AVR_CAN_USB_HOST_H
+
+/*
+ * Runs what ISR(PCINT1_vect) does on the target: drains the simulated
+ * MCP2515 while its INT line is asserted, then loads due cyclic frames.
+ * Receive buffer reads it leaves to the SPI interrupt are finished too.
+ */
+void host_serviceInterrupts(void);
+
+/*
+ * Runs what ISR(TIMER1_COMPA_vect) does for the schedule, once for every
+ * millisecond of millis() since the last call.
+ */
+void host_serviceTimer(void);
+
+#endif //AVR_CAN_USB_HOST_H
@@ -0,0 +1,56 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_MCP2515_SIM_H
+#define AVR_CAN_USB_MCP2515_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+/*
+ * Register-level MCP2515 model for the host build. It decodes the SPI
+ * instruction set (RESET, READ, WRITE, READ RX BUFFER, LOAD TX BUFFER,
+ * RTS, READ STATUS, RX STATUS, BIT MODIFY), applies masks and filters,
+ * BUKT rollover and overflow flags, and drives the INT line from
+ * CANINTF & CANINTE and the RXnBF pins from BFPCTRL.
+ *
+ * The virtual bus is one frame wide and synchronous: frames requested
+ * for transmission leave when chip select goes high and are captured
+ * for sim_takeTransmitted(); in loopback mode they are received instead.
+ * sim_setAcknowledge(false) leaves the adapter alone on the bus: its
+ * frames get no ACK, fail and are retried until they are aborted.
+ */
+struct sim_stats {
+    uint32_t transactions; /* chip select windows */
+    uint32_t spiBytes;
+    uint32_t received;     /* frames accepted into RXB0/RXB1 */
+    uint32_t overflows;    /* frames lost to RXnOVR */
+    uint32_t transmitted;
+};
+
+void sim_reset(void);
+bool sim_inject(const struct can_frame *frame);
+bool sim_takeTransmitted(struct can_frame *frame);
+void sim_setAcknowledge(bool ack);
+bool sim_intAsserted(void);
+bool sim_rxBufferFull(uint8_t n);
+uint8_t sim_readRegister(uint8_t address);
+const struct sim_stats *sim_getStats(void);
+void sim_clearStats(void);
+
+/*
+ * ISR(SPI_STC_vect) for the interrupt driven SPI_0 transfers: runs the
+ * callback of each one that finished, including those a callback starts.
+ */
+void sim_serviceSpi(void);
+
+/* the chip side of the SPI_0 and pin functions, for drivers outside the host build */
+uint8_t SPI_0_exchange_byte_polled(uint8_t data);
+void SS_set_level(const bool level);
+void TX0RTS_set_level(const bool level);
+void TX1RTS_set_level(const bool level);
+void TX2RTS_set_level(const bool level);
+
+#endif //AVR_CAN_USB_MCP2515_SIM_H
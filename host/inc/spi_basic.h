@@ -0,0 +1,29 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_SPI_BASIC_H
+#define AVR_CAN_USB_HOST_SPI_BASIC_H
+
+#include <stdint.h>
+
+/*
+ * Host replacement for the SPI_0 driver. Every byte goes to the simulated
+ * MCP2515 in mcp2515_sim.c; chip select is SS_set_level().
+ */
+typedef void (*spi_transfer_done_cb_t)(void);
+
+uint8_t SPI_0_exchange_byte(uint8_t data);
+void SPI_0_exchange_block(void *block, uint8_t size);
+void SPI_0_write_block(void *block, uint8_t size);
+void SPI_0_read_block(void *block, uint8_t size);
+void SPI_0_register_callback(spi_transfer_done_cb_t f);
+
+uint8_t SPI_0_exchange_byte_polled(uint8_t data);
+void SPI_0_exchange_block_polled(void *block, uint8_t size);
+void SPI_0_write_block_polled(const void *block, uint8_t size);
+void SPI_0_read_block_polled(void *block, uint8_t size);
+void SPI_0_start_byte_polled(uint8_t data);
+uint8_t SPI_0_finish_byte_polled(void);
+
+#endif //AVR_CAN_USB_HOST_SPI_BASIC_H
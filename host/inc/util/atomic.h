@@ -0,0 +1,8 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_UTIL_ATOMIC_H
+#define AVR_CAN_USB_HOST_UTIL_ATOMIC_H
+
+#endif //AVR_CAN_USB_HOST_UTIL_ATOMIC_H
@@ -0,0 +1,20 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_UTIL_CRC16_H
+#define AVR_CAN_USB_HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// same result as the avr-libc inline assembly version
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (uint8_t) ((crc << 1) ^ 0x07) : (uint8_t) (crc << 1);
+    }
+    return crc;
+}
+
+#endif //AVR_CAN_USB_HOST_UTIL_CRC16_H
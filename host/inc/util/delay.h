@@ -0,0 +1,12 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HOST_UTIL_DELAY_H
+#define AVR_CAN_USB_HOST_UTIL_DELAY_H
+
+// the simulated MCP2515 needs no settling time
+#define _delay_ms(ms) ((void) (ms))
+#define _delay_us(us) ((void) (us))
+
+#endif //AVR_CAN_USB_HOST_UTIL_DELAY_H
@@ -0,0 +1,65 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "host.h"
+#include <avr/io.h>
+#include <time.h>
+#include <driver_init.h>
+#include <mcp2515_sim.h>
+#include <millis.h>
+#include <canhacker.h>
+#include <schedule.h>
+#include <txqueue.h>
+
+volatile uint8_t PRR0;
+volatile uint8_t PCICR;
+volatile uint8_t PCIFR;
+volatile uint8_t PORTA, PORTB, PORTC, PORTD;
+volatile uint8_t DDRA, DDRB, DDRC, DDRD;
+volatile uint8_t PINA, PINB, PINC, PIND;
+
+static uint64_t host_nanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+unsigned long millis(void) {
+    return (unsigned long) (host_nanos() / 1000000ULL);
+}
+
+// wraps every hour like the Timer1 based version in tc16.c
+uint32_t micros(void) {
+    return (uint32_t) ((host_nanos() / 1000ULL) % (TIMESTAMP_WRAP_MILLIS * 1000ULL));
+}
+
+void host_serviceInterrupts(void) {
+    uint8_t held = holdInterrupt();
+    if (serviceInterrupt()) {
+        releaseInterrupt(held);
+        return;
+    }
+    // a receive buffer read runs on the SPI interrupt, its callback finishes the drain
+    sim_serviceSpi();
+}
+
+void host_serviceTimer(void) {
+    static bool started;
+    static uint32_t ticked;
+    uint32_t now = (uint32_t) millis();
+    if (!started) {
+        ticked = now;
+        started = true;
+    }
+    while ((int32_t) (now - ticked) > 0) {
+        ticked++;
+        if (schedule_tick(ticked)) {
+            uint8_t held = holdInterrupt();
+            if (held) {
+                txqueue_service();
+            }
+            releaseInterrupt(held);
+        }
+    }
+}
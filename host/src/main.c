@@ -0,0 +1,185 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <canhacker.h>
+#include <lib.h>
+#include "host.h"
+#include "mcp2515_sim.h"
+
+#define HOST_LINE_LENGTH 64
+
+static uint32_t benchBytes;
+
+/*
+ * Frame in SLCAN transmit syntax (t/T/r/R), used for the ">" lines that
+ * put a frame on the virtual bus.
+ */
+static int host_parseFrame(const char *line, size_t length, struct can_frame *frame) {
+    bool ext = (line[0] == 'T' || line[0] == 'R');
+    bool rtr = (line[0] == 'r' || line[0] == 'R');
+    size_t idLength = ext ? 8 : 3;
+    if ((line[0] != 't' && line[0] != 'T' && !rtr) || length < idLength + 2) {
+        return -1;
+    }
+    uint32_t id = 0;
+    for (size_t i = 1; i <= idLength; i++) {
+        id = (id << 4) | hexCharToByte(line[i]);
+    }
+    uint8_t dlc = hexCharToByte(line[idLength + 1]);
+    if (dlc > CAN_MAX_DLEN || (!rtr && length < idLength + 2 + 2u * dlc)) {
+        return -1;
+    }
+    memset(frame, 0, sizeof *frame);
+    frame->can_id = id | (ext ? CAN_EFF_FLAG : 0) | (rtr ? CAN_RTR_FLAG : 0);
+    frame->can_dlc = dlc;
+    if (!rtr) {
+        const char *data = &line[idLength + 2];
+        for (uint8_t i = 0; i < dlc; i++) {
+            frame->data[i] = (uint8_t) ((hexCharToByte(data[2 * i]) << 4) | hexCharToByte(data[2 * i + 1]));
+        }
+    }
+    return 0;
+}
+
+static void host_printFrame(FILE *out, const struct can_frame *frame) {
+    bool ext = (frame->can_id & CAN_EFF_FLAG) != 0;
+    bool rtr = (frame->can_id & CAN_RTR_FLAG) != 0;
+    if (ext) {
+        fprintf(out, "%c%08lX%u", rtr ? 'R' : 'T', (unsigned long) (frame->can_id & CAN_EFF_MASK), frame->can_dlc);
+    } else {
+        fprintf(out, "%c%03lX%u", rtr ? 'r' : 't', (unsigned long) (frame->can_id & CAN_SFF_MASK), frame->can_dlc);
+    }
+    for (uint8_t i = 0; !rtr && i < frame->can_dlc; i++) {
+        fprintf(out, "%02X", frame->data[i]);
+    }
+    fputc('\n', out);
+}
+
+static void host_drainBus(FILE *out) {
+    struct can_frame frame;
+    while (sim_takeTransmitted(&frame)) {
+        if (out != NULL) {
+            fputs("bus ", out);
+            host_printFrame(out, &frame);
+        }
+    }
+}
+
+/*
+ * Reads SLCAN commands from stdin and answers on stdout, like the adapter
+ * on its serial port. Lines starting with '>' put frames on the bus,
+ * "!noack" and "!ack" unplug and replug the other nodes; frames the
+ * adapter sends are listed on stderr.
+ */
+static int host_interactive(void) {
+    char line[HOST_LINE_LENGTH];
+    while (fgets(line, sizeof line, stdin) != NULL) {
+        size_t length = strcspn(line, "\r\n");
+        line[length] = '\0';
+        if (length == 0) {
+            continue;
+        }
+        if (line[0] == '>') {
+            // frames on one line arrive back to back, before the interrupt runs
+            for (char *text = strtok(&line[1], " "); text != NULL; text = strtok(NULL, " ")) {
+                struct can_frame frame;
+                if (host_parseFrame(text, strlen(text), &frame) != 0 || !sim_inject(&frame)) {
+                    fprintf(stderr, "frame not received: %s\n", text);
+                }
+            }
+        } else if (line[0] == '!') {
+            sim_setAcknowledge(strcmp(line, "!noack") != 0);
+        } else {
+            receiveCommand(line, (int) length);
+        }
+        host_serviceTimer();
+        host_serviceInterrupts();
+        pollReceiveCan();
+        flushReceiveCan();
+        host_drainBus(stderr);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static void bench_sink(const uint8_t *block, uint16_t size) {
+    (void) block;
+    benchBytes += size;
+}
+
+static double bench_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+static void bench_report(const char *name, uint32_t count, double seconds) {
+    const struct sim_stats *stats = sim_getStats();
+    printf("%-8s %8lu frames %8.1f ns/frame %6.2f SPI bytes/frame %5.2f CS/frame %6.2f serial bytes/frame\n",
+           name, (unsigned long) count, seconds * 1e9 / count,
+           (double) stats->spiBytes / count, (double) stats->transactions / count,
+           (double) benchBytes / count);
+}
+
+static void bench_command(const char *command) {
+    receiveCommand(command, (int) strlen(command));
+}
+
+/*
+ * Host side throughput of the firmware paths: frames received from the
+ * bus and formatted for the host, and transmit commands parsed and
+ * loaded into the MCP2515. The MCP2515 itself is free, so the numbers
+ * are firmware overhead and SPI traffic per frame.
+ */
+static int host_bench(uint32_t count) {
+    struct can_frame frame = {.can_id = 0x123, .can_dlc = 8, .data = {1, 2, 3, 4, 5, 6, 7, 8}};
+    const char *transmit = "t12381122334455667788";
+    double start;
+
+    setBlockWriter(bench_sink);
+    bench_command("S6");
+    bench_command("Z1");
+    bench_command("O");
+    host_drainBus(NULL);
+
+    sim_clearStats();
+    benchBytes = 0;
+    start = bench_seconds();
+    for (uint32_t i = 0; i < count; i++) {
+        frame.data[0] = (uint8_t) i;
+        sim_inject(&frame);
+        host_serviceInterrupts();
+        pollReceiveCan();
+    }
+    flushReceiveCan();
+    bench_report("rx", count, bench_seconds() - start);
+
+    sim_clearStats();
+    benchBytes = 0;
+    start = bench_seconds();
+    for (uint32_t i = 0; i < count; i++) {
+        bench_command(transmit);
+        host_serviceInterrupts();
+        host_drainBus(NULL);
+    }
+    bench_report("tx", count, bench_seconds() - start);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // as EXTERNAL_IRQ_0_init() leaves it
+    PCICR = 1 << PCIE1;
+    sim_reset();
+    CanHacker(stdout, getenv("AVR_CAN_USB_DEBUG") != NULL ? stderr : NULL);
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        uint32_t count = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 0) : 100000;
+        return host_bench(count == 0 ? 1 : count);
+    }
+    return host_interactive();
+}
@@ -0,0 +1,672 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "mcp2515_sim.h"
+#include <string.h>
+#include <driver_init.h>
+
+#define REG_BFPCTRL   0x0C
+#define REG_TXRTSCTRL 0x0D
+#define REG_CANSTAT   0x0E
+#define REG_CANCTRL   0x0F
+#define REG_TEC       0x1C
+#define REG_REC       0x1D
+#define REG_RXM0      0x20
+#define REG_RXM1      0x24
+#define REG_CANINTE   0x2B
+#define REG_CANINTF   0x2C
+#define REG_EFLG      0x2D
+#define REG_TXB0CTRL  0x30
+#define REG_RXB0CTRL  0x60
+#define REG_RXB1CTRL  0x70
+
+#define CANCTRL_REQOP   0xE0
+#define MODE_NORMAL     0x00
+#define MODE_LOOPBACK   0x40
+#define MODE_LISTENONLY 0x60
+#define MODE_CONFIG     0x80
+
+#define CANINTF_RX0IF 0x01
+#define CANINTF_RX1IF 0x02
+#define CANINTF_TX0IF 0x04
+#define CANINTF_ERRIF 0x20
+#define CANINTF_MERRF 0x80
+
+#define EFLG_EWARN  0x01
+#define EFLG_TXWAR  0x04
+#define EFLG_TXEP   0x10
+#define EFLG_RX0OVR 0x40
+#define EFLG_RX1OVR 0x80
+
+#define TEC_WARNING 96
+#define TEC_PASSIVE 128
+
+#define TXBCTRL_ABTF  0x40
+#define TXBCTRL_MLOA  0x20
+#define TXBCTRL_TXERR 0x10
+#define TXBCTRL_TXREQ 0x08
+#define TXBCTRL_TXP   0x03
+
+#define RXBCTRL_RXM   0x60
+#define RXBCTRL_RXRTR 0x08
+#define RXB0CTRL_BUKT 0x04
+#define RXB0CTRL_BUKT1 0x02
+
+#define SIDL_IDE 0x08
+#define SIDL_SRR 0x10
+#define DLC_RTR  0x40
+
+#define SIM_TX_CAPTURE 64
+
+enum sim_state {
+    SIM_IDLE,
+    SIM_INSTRUCTION,
+    SIM_ADDRESS,
+    SIM_READ,
+    SIM_WRITE,
+    SIM_STATUS,
+    SIM_MODIFY_ADDRESS,
+    SIM_MODIFY_MASK,
+    SIM_MODIFY_DATA,
+    SIM_DONE
+};
+
+enum sim_op {
+    OP_READ,
+    OP_WRITE
+};
+
+static uint8_t regs[128];
+static enum sim_state state = SIM_IDLE;
+static enum sim_op op;
+static uint8_t address;
+static uint8_t modifyMask;
+static uint8_t status;
+static uint8_t rxRelease; /* RXnIF to clear when chip select goes high */
+static bool selected;
+static uint8_t rtsPins;
+/* filter that accepted the frame in each RX buffer, 6/7 for rollover */
+static uint8_t filterHit[2];
+/* false while no other node acknowledges, every transmission fails */
+static bool acknowledged = true;
+
+static struct can_frame captured[SIM_TX_CAPTURE];
+static uint8_t capturedHead;
+static uint8_t capturedTail;
+
+static struct sim_stats stats;
+
+static void sim_transmitPending(void);
+
+static uint8_t *reg(uint8_t addr) {
+    addr &= 0x7F;
+    /* CANSTAT and CANCTRL are mirrored at the end of every row */
+    if ((addr & 0x0F) == REG_CANSTAT || (addr & 0x0F) == REG_CANCTRL) {
+        addr = (addr & 0x0F);
+    }
+    return &regs[addr];
+}
+
+static uint8_t sim_mode(void) {
+    return regs[REG_CANSTAT] & CANCTRL_REQOP;
+}
+
+/*
+ * Setting TXREQ clears the status of the previous attempt, clearing it
+ * while it is pending aborts the frame.
+ */
+static void sim_txRequestChanged(uint8_t *ctrl, uint8_t before) {
+    if ((*ctrl & TXBCTRL_TXREQ) && !(before & TXBCTRL_TXREQ)) {
+        *ctrl &= ~(TXBCTRL_ABTF | TXBCTRL_MLOA | TXBCTRL_TXERR);
+    } else if (!(*ctrl & TXBCTRL_TXREQ) && (before & TXBCTRL_TXREQ)) {
+        *ctrl |= TXBCTRL_ABTF;
+    }
+}
+
+static void sim_write(uint8_t addr, uint8_t value, uint8_t mask) {
+    uint8_t *r = reg(addr);
+    uint8_t writable;
+    bool txCtrl = false;
+    addr = (uint8_t) (r - regs);
+
+    switch (addr) {
+        case REG_CANSTAT:
+        case REG_TEC:
+        case REG_REC:
+            return;
+        case REG_EFLG:
+            writable = EFLG_RX0OVR | EFLG_RX1OVR;
+            break;
+        case REG_RXB0CTRL:
+            writable = RXBCTRL_RXM | RXB0CTRL_BUKT;
+            break;
+        case REG_RXB1CTRL:
+            writable = RXBCTRL_RXM;
+            break;
+        default:
+            writable = 0xFF;
+            if ((addr & 0x8F) == 0x00 && addr >= REG_TXB0CTRL && addr < REG_RXB0CTRL) {
+                writable = TXBCTRL_TXREQ | TXBCTRL_TXP; /* TXBnCTRL */
+                txCtrl = true;
+            }
+            break;
+    }
+    mask &= writable;
+    uint8_t before = *r;
+    *r = (uint8_t) ((*r & ~mask) | (value & mask));
+    if (txCtrl) {
+        sim_txRequestChanged(r, before);
+    }
+
+    if (addr == REG_CANCTRL) {
+        /* mode changes take effect at once */
+        regs[REG_CANSTAT] = (regs[REG_CANSTAT] & ~CANCTRL_REQOP) | (*r & CANCTRL_REQOP);
+    } else if (addr == REG_RXB0CTRL) {
+        regs[REG_RXB0CTRL] = (uint8_t) ((regs[REG_RXB0CTRL] & ~RXB0CTRL_BUKT1)
+                                        | ((regs[REG_RXB0CTRL] & RXB0CTRL_BUKT) ? RXB0CTRL_BUKT1 : 0));
+    }
+}
+
+void sim_reset(void) {
+    memset(regs, 0, sizeof regs);
+    regs[REG_CANCTRL] = 0x87;
+    regs[REG_CANSTAT] = MODE_CONFIG;
+    state = selected ? SIM_DONE : SIM_IDLE;
+    rxRelease = 0;
+    rtsPins = 0;
+    filterHit[0] = 0;
+    filterHit[1] = 0;
+    capturedHead = 0;
+    capturedTail = 0;
+    acknowledged = true;
+}
+
+static uint8_t sim_readStatus(void) {
+    uint8_t intf = regs[REG_CANINTF];
+    uint8_t value = intf & (CANINTF_RX0IF | CANINTF_RX1IF);
+    for (uint8_t n = 0; n < 3; n++) {
+        if (regs[REG_TXB0CTRL + 0x10 * n] & TXBCTRL_TXREQ) {
+            value |= 0x04 << (2 * n);
+        }
+        if (intf & (CANINTF_TX0IF << n)) {
+            value |= 0x08 << (2 * n);
+        }
+    }
+    return value;
+}
+
+static uint8_t sim_rxStatus(void) {
+    uint8_t intf = regs[REG_CANINTF];
+    uint8_t value = (uint8_t) ((intf & (CANINTF_RX0IF | CANINTF_RX1IF)) << 6);
+    uint8_t n;
+    if (intf & CANINTF_RX0IF) {
+        n = 0;
+    } else if (intf & CANINTF_RX1IF) {
+        n = 1;
+    } else {
+        return value;
+    }
+    uint8_t base = n ? REG_RXB1CTRL : REG_RXB0CTRL;
+    bool ext = (regs[base + 2] & SIDL_IDE) != 0;
+    bool rtr = ext ? (regs[base + 5] & DLC_RTR) != 0 : (regs[base + 2] & SIDL_SRR) != 0;
+    return (uint8_t) (value | (ext ? 0x10 : 0) | (rtr ? 0x08 : 0) | filterHit[n]);
+}
+
+static void sim_instruction(uint8_t data) {
+    switch (data) {
+        case 0xC0: /* RESET */
+            sim_reset();
+            return;
+        case 0x03:
+            op = OP_READ;
+            state = SIM_ADDRESS;
+            return;
+        case 0x02:
+            op = OP_WRITE;
+            state = SIM_ADDRESS;
+            return;
+        case 0x05:
+            state = SIM_MODIFY_ADDRESS;
+            return;
+        case 0xA0:
+            status = sim_readStatus();
+            state = SIM_STATUS;
+            return;
+        case 0xB0:
+            status = sim_rxStatus();
+            state = SIM_STATUS;
+            return;
+        default:
+            break;
+    }
+    if ((data & 0xF9) == 0x90) { /* READ RX BUFFER */
+        uint8_t n = (data >> 2) & 0x01;
+        address = (n ? REG_RXB1CTRL : REG_RXB0CTRL) + ((data & 0x02) ? 6 : 1);
+        rxRelease |= CANINTF_RX0IF << n;
+        state = SIM_READ;
+    } else if ((data & 0xF8) == 0x40 && (data & 0x07) <= 5) { /* LOAD TX BUFFER */
+        address = REG_TXB0CTRL + 0x10 * ((data & 0x07) >> 1) + ((data & 0x01) ? 6 : 1);
+        state = SIM_WRITE;
+    } else if ((data & 0xF8) == 0x80) { /* RTS */
+        for (uint8_t n = 0; n < 3; n++) {
+            if (data & (1 << n)) {
+                uint8_t *ctrl = &regs[REG_TXB0CTRL + 0x10 * n];
+                uint8_t before = *ctrl;
+                *ctrl |= TXBCTRL_TXREQ;
+                sim_txRequestChanged(ctrl, before);
+            }
+        }
+        state = SIM_DONE;
+    } else {
+        state = SIM_DONE;
+    }
+}
+
+static uint8_t sim_exchange(uint8_t data) {
+    uint8_t out = 0xFF;
+    stats.spiBytes++;
+    switch (state) {
+        case SIM_IDLE:
+        case SIM_DONE:
+            break;
+        case SIM_INSTRUCTION:
+            sim_instruction(data);
+            break;
+        case SIM_ADDRESS:
+            address = data & 0x7F;
+            state = (op == OP_READ) ? SIM_READ : SIM_WRITE;
+            break;
+        case SIM_READ:
+            out = *reg(address);
+            address = (address + 1) & 0x7F;
+            break;
+        case SIM_WRITE:
+            sim_write(address, data, 0xFF);
+            address = (address + 1) & 0x7F;
+            break;
+        case SIM_STATUS:
+            out = status;
+            break;
+        case SIM_MODIFY_ADDRESS:
+            address = data & 0x7F;
+            state = SIM_MODIFY_MASK;
+            break;
+        case SIM_MODIFY_MASK:
+            modifyMask = data;
+            state = SIM_MODIFY_DATA;
+            break;
+        case SIM_MODIFY_DATA:
+            sim_write(address, data, modifyMask);
+            state = SIM_DONE;
+            break;
+    }
+    return out;
+}
+
+void SS_set_level(const bool level) {
+    if (!level && !selected) {
+        selected = true;
+        state = SIM_INSTRUCTION;
+        stats.transactions++;
+    } else if (level && selected) {
+        selected = false;
+        state = SIM_IDLE;
+        regs[REG_CANINTF] &= ~rxRelease;
+        rxRelease = 0;
+        sim_transmitPending();
+    }
+}
+
+void SS_set_dir(const enum port_dir dir) {
+    (void) dir;
+}
+
+static void sim_rtsPin(uint8_t n, bool level) {
+    uint8_t bit = 1 << n;
+    /* a falling edge on a TXnRTS pin configured as request to send */
+    if (!level && (rtsPins & bit) && (regs[REG_TXRTSCTRL] & bit)) {
+        uint8_t *ctrl = &regs[REG_TXB0CTRL + 0x10 * n];
+        uint8_t before = *ctrl;
+        *ctrl |= TXBCTRL_TXREQ;
+        sim_txRequestChanged(ctrl, before);
+        sim_transmitPending();
+    }
+    rtsPins = level ? (rtsPins | bit) : (rtsPins & ~bit);
+}
+
+void TX0RTS_set_level(const bool level) {
+    sim_rtsPin(0, level);
+}
+
+void TX1RTS_set_level(const bool level) {
+    sim_rtsPin(1, level);
+}
+
+void TX2RTS_set_level(const bool level) {
+    sim_rtsPin(2, level);
+}
+
+bool INT_get_level(void) {
+    return !sim_intAsserted();
+}
+
+bool RX0BF_get_level(void) {
+    return !sim_rxBufferFull(0);
+}
+
+bool RX1BF_get_level(void) {
+    return !sim_rxBufferFull(1);
+}
+
+uint8_t SPI_0_exchange_byte_polled(uint8_t data) {
+    return sim_exchange(data);
+}
+
+void SPI_0_exchange_block_polled(void *block, uint8_t size) {
+    uint8_t *b = block;
+    while (size--) {
+        *b = sim_exchange(*b);
+        b++;
+    }
+}
+
+void SPI_0_write_block_polled(const void *block, uint8_t size) {
+    const uint8_t *b = block;
+    while (size--) {
+        sim_exchange(*b++);
+    }
+}
+
+void SPI_0_read_block_polled(void *block, uint8_t size) {
+    uint8_t *b = block;
+    while (size--) {
+        *b++ = sim_exchange(0);
+    }
+}
+
+// the simulated exchange is instant, the started byte is kept until it is collected
+static uint8_t sim_startedByte;
+
+void SPI_0_start_byte_polled(uint8_t data) {
+    sim_startedByte = sim_exchange(data);
+}
+
+uint8_t SPI_0_finish_byte_polled(void) {
+    return sim_startedByte;
+}
+
+// the interrupt driven blocks are exchanged at once, their callback runs from sim_serviceSpi()
+static spi_transfer_done_cb_t spiCallback;
+static bool spiDone;
+
+void SPI_0_register_callback(spi_transfer_done_cb_t f) {
+    spiCallback = f;
+}
+
+uint8_t SPI_0_exchange_byte(uint8_t data) {
+    return SPI_0_exchange_byte_polled(data);
+}
+
+void SPI_0_exchange_block(void *block, uint8_t size) {
+    SPI_0_exchange_block_polled(block, size);
+    spiDone = true;
+}
+
+void SPI_0_write_block(void *block, uint8_t size) {
+    SPI_0_write_block_polled(block, size);
+    spiDone = true;
+}
+
+void SPI_0_read_block(void *block, uint8_t size) {
+    SPI_0_read_block_polled(block, size);
+    spiDone = true;
+}
+
+void sim_serviceSpi(void) {
+    while (spiDone) {
+        spiDone = false;
+        if (spiCallback != NULL) {
+            spiCallback();
+        }
+    }
+}
+
+static uint32_t sim_regsToId(const uint8_t *r) {
+    uint32_t sid = ((uint32_t) r[0] << 3) | (r[1] >> 5);
+    if (r[1] & SIDL_IDE) {
+        return (sid << 18) | ((uint32_t) (r[1] & 0x03) << 16) | ((uint32_t) r[2] << 8) | r[3];
+    }
+    return sid;
+}
+
+static bool sim_match(uint8_t filter, uint8_t mask, const struct can_frame *frame) {
+    const uint8_t *f = &regs[filter];
+    const uint8_t *m = &regs[mask];
+    bool ext = (frame->can_id & CAN_EFF_FLAG) != 0;
+    if (((f[1] & SIDL_IDE) != 0) != ext) {
+        return false;
+    }
+    if (ext) {
+        uint32_t id = frame->can_id & CAN_EFF_MASK;
+        uint32_t fid = sim_regsToId(f);
+        uint32_t mid = sim_regsToId((const uint8_t[]) {m[0], (uint8_t) (m[1] | SIDL_IDE), m[2], m[3]});
+        return ((id ^ fid) & mid) == 0;
+    }
+    uint32_t id = frame->can_id & CAN_SFF_MASK;
+    if (((id ^ sim_regsToId(f)) & sim_regsToId((const uint8_t[]) {m[0], (uint8_t) (m[1] & ~SIDL_IDE), 0, 0})) != 0) {
+        return false;
+    }
+    /* for standard data frames EID8/EID0 are matched against the first data bytes */
+    if (!(frame->can_id & CAN_RTR_FLAG)) {
+        for (uint8_t i = 0; i < 2 && i < frame->can_dlc; i++) {
+            if ((frame->data[i] ^ f[2 + i]) & m[2 + i]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static const uint8_t filterAddress[6] = {0x00, 0x04, 0x08, 0x10, 0x14, 0x18};
+
+/*
+ * Index of the first filter of RXBn that accepts the frame, 0xFF when
+ * none does. With RXM = 11 every frame is accepted through filter 0 or 2.
+ */
+static uint8_t sim_accepts(uint8_t n, const struct can_frame *frame) {
+    uint8_t rxm = regs[n ? REG_RXB1CTRL : REG_RXB0CTRL] & RXBCTRL_RXM;
+    bool ext = (frame->can_id & CAN_EFF_FLAG) != 0;
+    uint8_t first = n ? 2 : 0;
+    uint8_t last = n ? 5 : 1;
+    if (rxm == RXBCTRL_RXM) {
+        return first;
+    }
+    if ((rxm == 0x20 && ext) || (rxm == 0x40 && !ext)) {
+        return 0xFF;
+    }
+    for (uint8_t i = first; i <= last; i++) {
+        if (sim_match(filterAddress[i], n ? REG_RXM1 : REG_RXM0, frame)) {
+            return i;
+        }
+    }
+    return 0xFF;
+}
+
+static void sim_load(uint8_t n, uint8_t hit, const struct can_frame *frame) {
+    uint8_t *r = &regs[n ? REG_RXB1CTRL : REG_RXB0CTRL];
+    bool ext = (frame->can_id & CAN_EFF_FLAG) != 0;
+    bool rtr = (frame->can_id & CAN_RTR_FLAG) != 0;
+    uint8_t dlc = frame->can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : frame->can_dlc;
+    if (ext) {
+        uint32_t id = frame->can_id & CAN_EFF_MASK;
+        r[1] = (uint8_t) (id >> 21);
+        r[2] = (uint8_t) (((id >> 13) & 0xE0) | SIDL_IDE | ((id >> 16) & 0x03));
+        r[3] = (uint8_t) (id >> 8);
+        r[4] = (uint8_t) id;
+    } else {
+        uint32_t id = frame->can_id & CAN_SFF_MASK;
+        r[1] = (uint8_t) (id >> 3);
+        r[2] = (uint8_t) (((id & 0x07) << 5) | (rtr ? SIDL_SRR : 0));
+        r[3] = 0;
+        r[4] = 0;
+    }
+    r[5] = (uint8_t) (((ext && rtr) ? DLC_RTR : 0) | dlc);
+    memcpy(&r[6], frame->data, CAN_MAX_DLEN);
+    /* FILHIT is bits 2..0 in RXB1CTRL, bit 0 in RXB0CTRL */
+    r[0] = (uint8_t) ((r[0] & ~(RXBCTRL_RXRTR | (n ? 0x07 : 0x01))) | (rtr ? RXBCTRL_RXRTR : 0));
+    if (n) {
+        r[0] |= (hit > 5) ? (hit - 6) : hit;
+    } else {
+        r[0] |= hit & 0x01;
+    }
+    filterHit[n] = hit;
+    regs[REG_CANINTF] |= CANINTF_RX0IF << n;
+    stats.received++;
+}
+
+static void sim_overflow(uint8_t n) {
+    regs[REG_EFLG] |= n ? EFLG_RX1OVR : EFLG_RX0OVR;
+    regs[REG_CANINTF] |= CANINTF_ERRIF;
+    stats.overflows++;
+}
+
+static bool sim_receive(const struct can_frame *frame) {
+    uint8_t hit = sim_accepts(0, frame);
+    if (hit != 0xFF) {
+        if (!(regs[REG_CANINTF] & CANINTF_RX0IF)) {
+            sim_load(0, hit, frame);
+            return true;
+        }
+        if (!(regs[REG_RXB0CTRL] & RXB0CTRL_BUKT)) {
+            sim_overflow(0);
+            return false;
+        }
+        /* rollover keeps the RXB0 filter hit, RX STATUS reports it as 6 or 7 */
+        if (regs[REG_CANINTF] & CANINTF_RX1IF) {
+            sim_overflow(1);
+            return false;
+        }
+        sim_load(1, hit + 6, frame);
+        return true;
+    }
+    hit = sim_accepts(1, frame);
+    if (hit == 0xFF) {
+        return false;
+    }
+    if (regs[REG_CANINTF] & CANINTF_RX1IF) {
+        sim_overflow(1);
+        return false;
+    }
+    sim_load(1, hit, frame);
+    return true;
+}
+
+bool sim_inject(const struct can_frame *frame) {
+    uint8_t mode = sim_mode();
+    if (mode != MODE_NORMAL && mode != MODE_LISTENONLY) {
+        return false;
+    }
+    return sim_receive(frame);
+}
+
+static void sim_frameFromTx(uint8_t n, struct can_frame *frame) {
+    const uint8_t *r = &regs[REG_TXB0CTRL + 0x10 * n];
+    frame->can_id = sim_regsToId(&r[1]);
+    if (r[2] & SIDL_IDE) {
+        frame->can_id |= CAN_EFF_FLAG;
+    }
+    if (r[5] & DLC_RTR) {
+        frame->can_id |= CAN_RTR_FLAG;
+    }
+    frame->can_dlc = r[5] & 0x0F;
+    if (frame->can_dlc > CAN_MAX_DLEN) {
+        frame->can_dlc = CAN_MAX_DLEN;
+    }
+    memcpy(frame->data, &r[6], CAN_MAX_DLEN);
+}
+
+/*
+ * An attempt without ACK. The retries happen at once: TEC climbs by 8
+ * per error up to error passive, where an ACK error no longer counts, so
+ * the frame stays pending with TXERR set and MERRF raised.
+ */
+static void sim_transmitError(uint8_t *ctrl) {
+    uint8_t eflg = regs[REG_EFLG];
+    while (regs[REG_TEC] < TEC_PASSIVE) {
+        regs[REG_TEC] += 8;
+    }
+    regs[REG_EFLG] |= EFLG_EWARN | EFLG_TXWAR | EFLG_TXEP;
+    if (regs[REG_EFLG] != eflg) {
+        regs[REG_CANINTF] |= CANINTF_ERRIF;
+    }
+    *ctrl |= TXBCTRL_TXERR;
+    regs[REG_CANINTF] |= CANINTF_MERRF;
+}
+
+/*
+ * Sends every buffer with TXREQ set, highest TXP first and the higher
+ * buffer number on a tie, like the arbitration inside the chip.
+ */
+static void sim_transmitPending(void) {
+    uint8_t mode = sim_mode();
+    if (mode != MODE_NORMAL && mode != MODE_LOOPBACK) {
+        return;
+    }
+    for (int8_t priority = 3; priority >= 0; priority--) {
+        for (int8_t n = 2; n >= 0; n--) {
+            uint8_t *ctrl = &regs[REG_TXB0CTRL + 0x10 * n];
+            if (!(*ctrl & TXBCTRL_TXREQ) || (*ctrl & TXBCTRL_TXP) != priority) {
+                continue;
+            }
+            if (mode == MODE_NORMAL && !acknowledged) {
+                sim_transmitError(ctrl);
+                continue;
+            }
+            struct can_frame frame;
+            sim_frameFromTx((uint8_t) n, &frame);
+            if (mode == MODE_LOOPBACK) {
+                sim_receive(&frame);
+            } else if ((uint8_t) (capturedHead - capturedTail) < SIM_TX_CAPTURE) {
+                captured[capturedHead++ % SIM_TX_CAPTURE] = frame;
+            }
+            *ctrl &= ~TXBCTRL_TXREQ;
+            regs[REG_CANINTF] |= CANINTF_TX0IF << n;
+            stats.transmitted++;
+        }
+    }
+}
+
+void sim_setAcknowledge(bool ack) {
+    acknowledged = ack;
+}
+
+bool sim_takeTransmitted(struct can_frame *frame) {
+    if (capturedTail == capturedHead) {
+        return false;
+    }
+    *frame = captured[capturedTail++ % SIM_TX_CAPTURE];
+    return true;
+}
+
+bool sim_intAsserted(void) {
+    return (regs[REG_CANINTF] & regs[REG_CANINTE]) != 0;
+}
+
+/* RXnBF in buffer-full mode: BnBFE and BnBFM set, low while RXnIF is */
+bool sim_rxBufferFull(uint8_t n) {
+    uint8_t mode = (uint8_t) (0x05 << n);
+    return (regs[REG_BFPCTRL] & mode) == mode && (regs[REG_CANINTF] & (CANINTF_RX0IF << n)) != 0;
+}
+
+uint8_t sim_readRegister(uint8_t addr) {
+    return *reg(addr);
+}
+
+const struct sim_stats *sim_getStats(void) {
+    return &stats;
+}
+
+void sim_clearStats(void) {
+    memset(&stats, 0, sizeof stats);
+}
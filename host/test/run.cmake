@@ -0,0 +1,17 @@
+# Feeds INPUT to the host build and checks what it answers on stdout:
+#   cmake -DHOST=<avr-can-usb-host> -DINPUT=<file> -DEXPECT=<regex> [-DREJECT=<regex>] -P run.cmake
+# Newlines in INPUT end the commands; CR in the answers is matched as \r.
+execute_process(COMMAND ${HOST}
+        INPUT_FILE ${INPUT}
+        OUTPUT_VARIABLE output
+        RESULT_VARIABLE result)
+string(REPLACE "\r" "|" shown "${output}")
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${HOST} exited with ${result}, output: ${shown}")
+endif ()
+if (NOT output MATCHES "${EXPECT}")
+    message(FATAL_ERROR "output \"${shown}\" does not match \"${EXPECT}\"")
+endif ()
+if (DEFINED REJECT AND output MATCHES "${REJECT}")
+    message(FATAL_ERROR "output \"${shown}\" matches \"${REJECT}\"")
+endif ()
@@ -0,0 +1,72 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_BINFRAME_H
+#define AVR_CAN_USB_BINFRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+/*
+ * Compact binary host protocol, enabled with the "B1" command.
+ *
+ * Every record is COBS encoded and terminated with a single 0x00 byte:
+ *
+ *   CAN frame: 0x01 | flags | id (2 bytes SFF, 4 bytes EFF) | timestamp (4) | [sequence] | data (dlc) | [filter] | crc8
+ *   response:  0x02 | ASCII response ("\r", "\a", "V1010\r", ...) | crc8
+ *   batch:     0x03 | count | count x (flags | id | timestamp | [sequence] | data | [filter]) | crc8
+ *
+ * A batch ("B2" command) carries several frames under one header, crc and
+ * delimiter; its entries are CAN frame records without type and crc.
+ *
+ * flags: bit 7 EFF, bit 6 RTR, bit 5 filter byte present (H1), bit 4 sequence
+ * byte present, bits 3..0 DLC.
+ * sequence counts the frames read from the MCP2515 in bus order, modulo
+ * 256; a gap means frames were lost in the adapter.
+ * filter is the MCP2515 filter, RXF0..RXF5, that accepted the frame.
+ * timestamp is in microseconds and wraps every hour.
+ * Multi-byte fields are little endian. crc8 is CRC-8/CCITT (poly 0x07,
+ * init 0) over all preceding bytes of the record.
+ */
+
+#define BINFRAME_TYPE_CAN      0x01
+#define BINFRAME_TYPE_RESPONSE 0x02
+#define BINFRAME_TYPE_BATCH    0x03
+
+#define BINFRAME_FLAG_EFF 0x80
+#define BINFRAME_FLAG_RTR 0x40
+#define BINFRAME_FLAG_FILTER 0x20
+#define BINFRAME_FLAG_SEQUENCE 0x10
+#define BINFRAME_DLC_MASK 0x0F
+
+#define BINFRAME_DELIMITER 0x00
+
+// filter argument that leaves the filter byte out
+#define BINFRAME_NO_FILTER 0xFF
+// sequence argument that leaves the sequence byte out
+#define BINFRAME_NO_SEQUENCE 0xFFFF
+
+// type, flags, 4 id, 4 timestamp, sequence, 8 data, filter, crc
+#define BINFRAME_MAX_RECORD 21
+#define BINFRAME_MAX_RESPONSE 16
+// flags, 4 id, 4 timestamp, sequence, 8 data, filter
+#define BINFRAME_MAX_ENTRY 19
+// COBS code byte, type and count in front of the first entry
+#define BINFRAME_BATCH_HEADER 3
+// crc and delimiter added by binframe_finishBatch()
+#define BINFRAME_BATCH_TRAILER 2
+// longest batch record that still encodes without a 0xFF COBS block
+#define BINFRAME_MAX_BATCH 253
+// COBS adds one byte per 254 plus the delimiter
+#define BINFRAME_MAX_ENCODED(n) ((n) + 2)
+
+uint8_t binframe_encodeCan(const struct can_frame *frame, uint32_t timestamp, uint16_t sequence, uint8_t filter,
+                           uint8_t *out);
+uint8_t binframe_encodeResponse(const char *response, uint8_t *out);
+uint8_t binframe_encodeEntry(const struct can_frame *frame, uint32_t timestamp, uint16_t sequence, uint8_t filter,
+                             uint8_t *out);
+uint8_t binframe_finishBatch(uint8_t *batch, uint8_t length);
+
+#endif //AVR_CAN_USB_BINFRAME_H
@@ -15,7 +15,8 @@
 #define MAX_MESSAGE_DATA_HEX_LENGTH CAN_MAX_DLEN * HEX_PER_BYTE
 #define MIN_MESSAGE_LENGTH 5
 
-#define CANHACKER_CMD_MAX_LENGTH 26
+// Y with an extended 8 byte frame: 'Y' + slot + 4 period + 4 offset + 2 bytes + 26 frame
+#define CANHACKER_CMD_MAX_LENGTH 38
 
 #define CANHACKER_SERIAL_RESPONSE     "N0001\r"
 #define CANHACKER_SW_VERSION_RESPONSE "v0107\r"
@@ -42,17 +43,32 @@ enum ERROR {
     ERROR_MCP2515_MERRF
 };
 
+typedef int8_t (*baudrate_handler_t)(uint32_t baud);
+typedef void (*block_writer_t)(const uint8_t *block, uint16_t size);
+typedef uint8_t (*block_reader_t)(uint8_t *block, uint8_t size, uint8_t delimiter);
+
 void CanHacker(FILE* stream, FILE* debugStream);
 void setClock(enum CAN_CLOCK clock);
+void setBaudrateHandler(baudrate_handler_t handler);
+void setBlockWriter(block_writer_t writer);
+void setBlockReader(block_reader_t reader);
 enum ERROR receiveCommand(const char *buffer, int length);
+enum ERROR pollCommand(void);
 enum ERROR receiveCanFrame(const struct can_frame *frame);
 enum ERROR sendFrame(const struct can_frame *frame);
 enum ERROR enableLoopback(void);
 enum ERROR disableLoopback(void);
 enum ERROR pollReceiveCan(void);
+enum ERROR flushReceiveCan(void);
 enum ERROR receiveCan(enum RXBn rxBuffer);
+bool serviceInterrupt(void);
 enum ERROR processInterrupt(void);
 FILE* getInterfaceStream(void);
 
+#ifdef CANHACKER_BENCH
+enum ERROR canhacker_benchCreateTransmit(const struct can_frame *frame, char *buffer, int length);
+enum ERROR canhacker_benchParseTransmit(const char *buffer, int length, struct can_frame *frame);
+#endif
+
 
 #endif //AVR_CAN_USB_CANHACKER_H
@@ -0,0 +1,67 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_FILTER_H
+#define AVR_CAN_USB_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+#include "mcp2515.h"
+
+#ifndef FILTER_RULES
+#define FILTER_RULES 24
+#endif
+
+// extended ids looked up by binary search, further extended rules are scanned
+#ifndef FILTER_EXT_IDS
+#define FILTER_EXT_IDS 16
+#endif
+
+#define FILTER_MASKS 2
+#define FILTER_FILTERS 6
+
+/*
+ * Accepted identifiers: frames whose can_id matches id on the bits set in
+ * mask. CAN_EFF_FLAG in id selects extended frames, id and mask are in
+ * can_id layout (11 or 29 bits).
+ */
+struct filter_rule {
+    uint32_t id;
+    uint32_t mask;
+};
+
+/*
+ * RXM0/RXM1 and RXF0..RXF5 as computed by filter_plan(). Masks and filter
+ * ids use the 29 bit register layout, standard ids in bits 28..18. RXF0
+ * and RXF1 belong to RXM0, RXF2..RXF5 to RXM1; an ordered plan repeats
+ * the RXM0 group there. exact is false when the registers let through
+ * more than the rules ask for.
+ */
+struct filter_plan {
+    uint32_t mask[FILTER_MASKS];
+    uint32_t filter[FILTER_FILTERS];
+    bool ext[FILTER_FILTERS];
+    bool exact;
+};
+
+/*
+ * Acceptance filtering for the receive path. The rules are turned into
+ * the best fitting MCP2515 masks and filters, so unwanted frames are
+ * dropped before they cost SPI traffic; when six filters under two masks
+ * cannot express the rules exactly, filter_accepts() checks the frames
+ * that got through: standard ids against a 2048 bit bitmap, extended ids
+ * against a sorted table. No rules means every frame is accepted.
+ */
+void filter_clear(void);
+bool filter_add(uint32_t id, uint32_t mask);
+bool filter_addRange(uint32_t first, uint32_t last);
+void filter_setSja1000(uint32_t acr, uint32_t amr, bool singleFilter);
+uint8_t filter_count(void);
+void filter_setOrdered(bool ordered);
+void filter_plan(struct filter_plan *plan);
+enum MCP2515_ERROR filter_apply(void);
+bool filter_accepts(const struct can_frame *frame);
+
+#endif //AVR_CAN_USB_FILTER_H
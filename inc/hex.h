@@ -0,0 +1,60 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_HEX_H
+#define AVR_CAN_USB_HEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+/*
+ * Table driven hex conversions for the ASCII protocol. Encoding reads
+ * both characters of a byte from hex_pairs, decoding looks every
+ * character up in hex_values, which also tells invalid characters apart.
+ */
+
+#define HEX_INVALID 0xFF
+
+// upper case digits of every byte value, 512 bytes of flash
+extern const char hex_pairs[256][2] PROGMEM;
+
+// digit value + 1 of every character, 0 for characters that are no hex digit
+extern const uint8_t hex_values[256] PROGMEM;
+
+static inline void hex_putByte(char *out, uint8_t byte) {
+    out[0] = pgm_read_byte(&hex_pairs[byte][0]);
+    out[1] = pgm_read_byte(&hex_pairs[byte][1]);
+}
+
+static inline char hex_digit(uint8_t nibble) {
+    return pgm_read_byte(&hex_pairs[nibble & 0x0F][1]);
+}
+
+/*
+ * Value of a hex digit, upper or lower case, or HEX_INVALID.
+ */
+static inline uint8_t hex_nibble(char c) {
+    return pgm_read_byte(&hex_values[(uint8_t) c]) - 1;
+}
+
+/*
+ * Two hex digits into *byte. Returns false, and leaves *byte alone, when
+ * one of them is no hex digit.
+ */
+static inline bool hex_getByte(const char *in, uint8_t *byte) {
+    uint8_t hi = hex_nibble(in[0]);
+    uint8_t lo = hex_nibble(in[1]);
+    if ((hi | lo) == HEX_INVALID) {
+        return false;
+    }
+    *byte = (hi << 4) | lo;
+    return true;
+}
+
+void hex_putId(char *out, uint32_t id, bool extended);
+
+bool hex_get(const char *in, uint8_t digits, uint32_t *value);
+
+#endif //AVR_CAN_USB_HEX_H
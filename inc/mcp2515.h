@@ -203,6 +203,12 @@ enum CAN_CLKOUT {
     CLKOUT_DIV8 = 0x3,
 };
 
+struct bit_timing {
+    uint8_t cnf1;
+    uint8_t cnf2;
+    uint8_t cnf3;
+};
+
 enum MCP2515_ERROR {
     MCP2515_ERROR_OK        = 0,
     MCP2515_ERROR_FAIL      = 1,
@@ -237,6 +243,28 @@ enum TXBn {
     TXB2 = 2
 };
 
+// TXBnSIDH..TXBnD7, the bytes LOAD TX BUFFER writes
+#define MCP_TXB_IMAGE_LENGTH 13
+#define MCP_TXB_PRIORITY_HIGHEST 3
+
+/*
+ * Register reads, writes and bit modifies collected with queueRead(),
+ * queueWrite() and queueModify() and clocked out back to back by
+ * runTransaction(): one chip-select window per instruction, with writes
+ * and reads of consecutive registers merged into one, and the pin change
+ * interrupt held once for all of them. The caller provides the storage,
+ * MCP_TRANSACTION_BYTES() of it.
+ */
+struct mcp_transaction {
+    uint8_t *ops; // instruction, address, count, payload, ...
+    uint8_t size;
+    uint8_t length;
+    uint8_t last; // offset of the last instruction, the one the next may extend
+};
+
+// instruction, address and count per instruction plus written bytes and bit modify mask/data pairs
+#define MCP_TRANSACTION_BYTES(instructions, payload) (3 * (instructions) + (payload))
+
 enum /*class*/ CANINTF {
     CANINTF_RX0IF = 0x01,
     CANINTF_RX1IF = 0x02,
@@ -248,6 +276,17 @@ enum /*class*/ CANINTF {
     CANINTF_MERRF = 0x80
 };
 
+// RX STATUS instruction result
+enum /*class*/ RXSTATUS {
+    RXSTATUS_RXB0 = 0x40,
+    RXSTATUS_RXB1 = 0x80,
+    RXSTATUS_EXT = 0x10,
+    RXSTATUS_RTR = 0x08,
+    // RXF0..RXF5, 6 and 7 are RXF0 and RXF1 rolled over into RXB1
+    RXSTATUS_FILHIT_MASK = 0x07
+};
+#define RXSTATUS_ROLLOVER 6
+
 enum /*class*/ EFLG {
     EFLG_RX1OVR = (1<<7),
     EFLG_RX0OVR = (1<<6),
@@ -260,6 +299,8 @@ enum /*class*/ EFLG {
 };
 
 void MCP2515(void);
+uint8_t holdInterrupt(void);
+void releaseInterrupt(const uint8_t held);
 enum MCP2515_ERROR reset(void);
 enum MCP2515_ERROR setConfigMode(void);
 enum MCP2515_ERROR setListenOnlyMode(void);
@@ -269,25 +310,50 @@ enum MCP2515_ERROR setNormalMode(void);
 enum MCP2515_ERROR setClkOut(const enum CAN_CLKOUT divisor);
 enum MCP2515_ERROR setBitrate(const enum CAN_SPEED canSpeed);
 enum MCP2515_ERROR setBitrateWithCANClock(const enum CAN_SPEED canSpeed, const enum CAN_CLOCK canClock);
+enum MCP2515_ERROR setBitTiming(const struct bit_timing *timing);
+enum MCP2515_ERROR calculateBitTiming(const enum CAN_CLOCK canClock, const uint32_t bitrate,
+                                      const uint16_t samplePoint, uint8_t sjw, const bool tripleSample,
+                                      struct bit_timing *timing);
 enum MCP2515_ERROR setFilterMask(const enum MASK num, const bool ext, const uint32_t ulData);
 enum MCP2515_ERROR setFilter(const enum RXF num, const bool ext, const uint32_t ulData);
+enum MCP2515_ERROR setFilters(const uint32_t masks[2], const uint32_t filters[6], const uint8_t extFilters);
+enum MCP2515_ERROR prepareMessage(const struct can_frame *frame, uint8_t image[MCP_TXB_IMAGE_LENGTH]);
+void sendImageThroughTXBn(const enum TXBn txbn, const uint8_t image[MCP_TXB_IMAGE_LENGTH], const uint8_t priority);
 enum MCP2515_ERROR sendMessageThroughTXBn(const enum TXBn txbn, const struct can_frame *frame);
 enum MCP2515_ERROR sendMessage(const struct can_frame *frame);
 enum MCP2515_ERROR readMessageThroughRXBn(const enum RXBn rxbn, struct can_frame *frame);
 enum MCP2515_ERROR readMessage(struct can_frame *frame);
+#ifdef MCP2515_RX_SPI_INTERRUPT
+void startReadMessage(const enum RXBn rxbn, void (*done)(void));
+void finishReadMessage(struct can_frame *frame);
+bool readMessageRunning(void);
+#endif
 bool checkReceive(void);
 bool checkError(void);
 uint8_t getErrorFlags(void);
 void clearRXnOVRFlags(void);
+bool isInterruptAsserted(void);
+uint8_t getFullRxBuffers(void);
 uint8_t getInterrupts(void);
 uint8_t getInterruptMask(void);
 void clearInterrupts(void);
 void clearTXInterrupts(void);
+void clearTXnIF(const uint8_t txif);
+uint8_t abortTransmissions(const uint8_t txbuffers, const bool onlyFailed);
 uint8_t getStatus(void);
+uint8_t getRxStatus(void);
+uint8_t getFilterHit(const enum RXBn rxbn);
 void clearRXnOVR(void);
 void clearMERR(void);
 void clearERRIF(void);
+void clearWAKIF(void);
 uint8_t errorCountRX(void);
 uint8_t errorCountTX(void);
+uint8_t acknowledgeErrors(void);
+void beginTransaction(struct mcp_transaction *transaction, uint8_t ops[], const uint8_t size);
+bool queueRead(struct mcp_transaction *transaction, const uint8_t reg, const uint8_t n);
+bool queueWrite(struct mcp_transaction *transaction, const uint8_t reg, const uint8_t values[], const uint8_t n);
+bool queueModify(struct mcp_transaction *transaction, const uint8_t reg, const uint8_t mask, const uint8_t data);
+void runTransaction(const struct mcp_transaction *transaction, uint8_t results[]);
 
 #endif //AVR_CAN_USB_MCP2515_H
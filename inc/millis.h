@@ -5,4 +5,15 @@
 #ifndef AVR_CAN_USB_MILLIS_H
 #define AVR_CAN_USB_MILLIS_H
 
+#include <stdint.h>
+
+/*
+ * micros() wraps every hour rather than at 2^32 so that dividing it by
+ * 1000 still gives a continuous 60000 ms CanHacker timestamp.
+ */
+#define TIMESTAMP_WRAP_MILLIS 3600000UL
+
+unsigned long millis(void);
+uint32_t micros(void);
+
 #endif //AVR_CAN_USB_MILLIS_H
@@ -0,0 +1,48 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_RXRING_H
+#define AVR_CAN_USB_RXRING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can.h"
+
+// must be a power of two, at most 128
+#ifndef RXRING_SIZE
+#define RXRING_SIZE 32
+#endif
+#define RXRING_MASK (RXRING_SIZE - 1)
+
+#if (RXRING_SIZE & RXRING_MASK) != 0 || RXRING_SIZE > 128
+#error RXRING_SIZE must be a power of two not greater than 128
+#endif
+
+// filter of frames whose filter was not read, without H1 or through receiveCan()
+#define RX_FILTER_UNKNOWN 0x0F
+
+struct rx_frame {
+    struct can_frame frame;
+    uint32_t timestamp; /* micros() when the MCP2515 interrupt was serviced */
+    uint8_t filter; /* RXF0..RXF5 that accepted the frame */
+    uint8_t sequence; /* frames read from the MCP2515 before this one, modulo 256 */
+};
+
+/*
+ * Single-producer/single-consumer ring of received frames.
+ * The producer is the PCINT1 handler, the consumer is the main loop.
+ * Head and tail are 8 bit so both sides read them atomically and
+ * no critical section is needed.
+ */
+void rxring_init(void);
+struct rx_frame *rxring_reserve(void);
+void rxring_commit(void);
+void rxring_drop(void);
+struct rx_frame *rxring_peek(void);
+void rxring_release(void);
+uint8_t rxring_count(void);
+uint16_t rxring_overflows(void);
+
+#endif //AVR_CAN_USB_RXRING_H
@@ -0,0 +1,43 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_SCHEDULE_H
+#define AVR_CAN_USB_SCHEDULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+#ifndef SCHEDULE_SIZE
+#define SCHEDULE_SIZE 16
+#endif
+
+#if SCHEDULE_SIZE > 16
+#error SCHEDULE_SIZE must not be greater than 16, the Y command addresses slots with one hex digit
+#endif
+
+// counter or checksum byte not used
+#define SCHEDULE_NO_BYTE 0xFF
+
+/*
+ * Cyclic frames sent by the device itself. Every slot holds a frame, its
+ * period and phase offset in milliseconds of the Timer1 clock (millis()),
+ * and optionally a data byte whose low nibble counts 0..15 and a data
+ * byte that carries the XOR of the other data bytes.
+ *
+ * ISR(TIMER1_COMPA_vect) calls schedule_tick() every millisecond and the
+ * transmit queue takes the due frames with schedule_take() ahead of the
+ * frames the host queued, so neither the main loop nor host traffic
+ * delays them.
+ */
+void schedule_init(void);
+bool schedule_set(uint8_t slot, const struct can_frame *frame, uint16_t period, uint16_t offset,
+                  uint8_t counterByte, uint8_t checksumByte, uint32_t now);
+void schedule_remove(uint8_t slot);
+void schedule_start(uint32_t now);
+void schedule_stop(void);
+bool schedule_tick(uint32_t now);
+const struct can_frame *schedule_take(void);
+
+#endif //AVR_CAN_USB_SCHEDULE_H
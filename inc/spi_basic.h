@@ -82,6 +82,59 @@ bool SPI_0_status_busy(void);
 
 bool SPI_0_status_done(void);
 
+void SPI_0_init_polled(void);
+
+void SPI_0_exchange_block_polled(void *block, uint8_t size);
+
+void SPI_0_write_block_polled(const void *block, uint8_t size);
+
+void SPI_0_read_block_polled(void *block, uint8_t size);
+
+/**
+ * \brief Exchange one byte without the SPI interrupt
+ *
+ * Only valid after SPI_0_init_polled(). At fosc/2 the transfer takes
+ * 16 CPU cycles, less than an interrupt entry and exit.
+ *
+ * \param[in] data The byte to send
+ *
+ * \return The byte received
+ */
+static inline uint8_t SPI_0_exchange_byte_polled(uint8_t data)
+{
+	SPDR = data;
+	while (!(SPSR & (1 << SPIF)))
+		;
+	return SPDR;
+}
+
+/**
+ * \brief Start exchanging one byte without waiting for it
+ *
+ * The CPU is free for the 16 cycles the byte takes; collect it with
+ * SPI_0_finish_byte_polled() before the next transfer.
+ *
+ * \param[in] data The byte to send
+ *
+ * \return Nothing
+ */
+static inline void SPI_0_start_byte_polled(uint8_t data)
+{
+	SPDR = data;
+}
+
+/**
+ * \brief Wait for the byte started with SPI_0_start_byte_polled()
+ *
+ * \return The byte received
+ */
+static inline uint8_t SPI_0_finish_byte_polled(void)
+{
+	while (!(SPSR & (1 << SPIF)))
+		;
+	return SPDR;
+}
+
 #ifdef __cplusplus
 }
 #endif
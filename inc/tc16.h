@@ -7,6 +7,12 @@
 
 #include <compiler.h>
 
+/* 14.7456 MHz / 8 gives 1843.2 ticks per millisecond */
+#define TIMER_0_TICKS_PER_MS 1843
+#define TIMER_0_TOP (TIMER_0_TICKS_PER_MS - 1)
+/* every fifth period is one tick longer to make up the 0.2 tick */
+#define TIMER_0_LONG_PERIOD 5
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -0,0 +1,49 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#ifndef AVR_CAN_USB_TXQUEUE_H
+#define AVR_CAN_USB_TXQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+#include "mcp2515.h"
+
+// must be a power of two, at most 128; an entry takes 13 bytes of SRAM
+#ifndef TXQUEUE_SIZE
+#define TXQUEUE_SIZE 64
+#endif
+#define TXQUEUE_MASK (TXQUEUE_SIZE - 1)
+
+#if (TXQUEUE_SIZE & TXQUEUE_MASK) != 0 || TXQUEUE_SIZE > 128
+#error TXQUEUE_SIZE must be a power of two not greater than 128
+#endif
+
+/*
+ * Frames waiting for an MCP2515 transmit buffer. The main loop queues
+ * them, ISR(PCINT1_vect) moves the next one into TXB0..TXB2 whenever a
+ * TXnIF frees a buffer, so the chip always has the following frames
+ * ready while one is on the bus. Cyclic frames from the schedule are not
+ * queued here: they are taken ahead of the queued ones whenever a buffer
+ * is loaded, so at most the three frames already in the MCP2515 go
+ * before them.
+ *
+ * Entries are stored as transmit buffer images, the interrupt only copies
+ * them over SPI. Frames leave in the order they were queued: each loaded
+ * buffer gets a lower TXP than the ones still pending, and when TXP 0 is
+ * taken loading waits until the pending buffers are sent.
+ *
+ * A buffer is freed by its TXnIF, or by txqueue_error() when its frame
+ * failed while the MCP2515 is error passive or bus off; that frame is
+ * dropped and the next one takes its place.
+ */
+void txqueue_init(void);
+bool txqueue_push(const struct can_frame *frame);
+void txqueue_service(void);
+void txqueue_transmitted(uint8_t txif);
+uint8_t txqueue_error(uint8_t eflg);
+uint8_t txqueue_count(void);
+bool txqueue_full(void);
+
+#endif //AVR_CAN_USB_TXQUEUE_H
@@ -31,13 +31,33 @@
 #include <atmel_start.h>
 #include <stdbool.h>
 
-/* USART_0 Ringbuffer */
-
-#define USART_0_RX_BUFFER_SIZE 32
-#define USART_0_TX_BUFFER_SIZE 32
+/* USART_0 Ringbuffer, sizes must be powers of two and can be set from CMakeLists.txt */
+
+#ifndef USART_0_RX_BUFFER_SIZE
+#define USART_0_RX_BUFFER_SIZE 128
+#endif
+#ifndef USART_0_TX_BUFFER_SIZE
+#define USART_0_TX_BUFFER_SIZE 512
+#endif
 #define USART_0_RX_BUFFER_MASK (USART_0_RX_BUFFER_SIZE - 1)
 #define USART_0_TX_BUFFER_MASK (USART_0_TX_BUFFER_SIZE - 1)
 
+#if (USART_0_RX_BUFFER_SIZE & USART_0_RX_BUFFER_MASK) != 0 || (USART_0_TX_BUFFER_SIZE & USART_0_TX_BUFFER_MASK) != 0
+#error USART_0 buffer sizes must be powers of two
+#endif
+
+/* The element counters must hold the full size, so 8 bit indices only go up to 128 */
+#if USART_0_RX_BUFFER_SIZE > 128
+typedef uint16_t usart_0_rx_index_t;
+#else
+typedef uint8_t usart_0_rx_index_t;
+#endif
+#if USART_0_TX_BUFFER_SIZE > 128
+typedef uint16_t usart_0_tx_index_t;
+#else
+typedef uint8_t usart_0_tx_index_t;
+#endif
+
 typedef enum { RX_CB = 1, UDRE_CB } usart_cb_type_t;
 typedef void (*usart_cb_t)(void);
 
@@ -61,8 +81,20 @@ bool USART_0_is_tx_busy(void);
 
 uint8_t USART_0_read(void);
 
+uint8_t USART_0_read_until(uint8_t *block, uint8_t size, uint8_t delimiter);
+
 void USART_0_write(uint8_t data);
 
+void USART_0_write_block(const uint8_t *block, uint16_t size);
+
 void USART_0_set_ISR_cb(usart_cb_t cb, usart_cb_type_t type);
 
+void USART_0_flush(void);
+
+usart_0_rx_index_t USART_0_get_rx_high_water(void);
+
+usart_0_tx_index_t USART_0_get_tx_high_water(void);
+
+int8_t USART_0_set_baudrate(uint32_t baud);
+
 #endif /* USART_BASIC_H_INCLUDED */
@@ -0,0 +1,145 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "binframe.h"
+#include <util/crc16.h>
+
+static uint8_t binframe_finish(uint8_t *record, uint8_t length, uint8_t *out);
+
+static uint8_t binframe_cobs(const uint8_t *in, uint8_t length, uint8_t *out);
+
+static uint8_t *put_le(uint8_t *buf, uint32_t value, uint8_t bytes) {
+    while (bytes--) {
+        *buf++ = (uint8_t) value;
+        value >>= 8;
+    }
+    return buf;
+}
+
+/*
+ * Encodes a received frame into out, which must hold
+ * BINFRAME_MAX_ENCODED(BINFRAME_MAX_RECORD) bytes.
+ * Returns the number of bytes including the delimiter.
+ */
+uint8_t binframe_encodeCan(const struct can_frame *frame, uint32_t timestamp, uint16_t sequence, uint8_t filter,
+                           uint8_t *out) {
+    uint8_t record[BINFRAME_MAX_RECORD];
+
+    record[0] = BINFRAME_TYPE_CAN;
+    return binframe_finish(record, 1 + binframe_encodeEntry(frame, timestamp, sequence, filter, &record[1]), out);
+}
+
+/*
+ * The frame fields of a CAN frame record, without type and crc; out must
+ * hold BINFRAME_MAX_ENTRY bytes. Returns the number of bytes written.
+ */
+uint8_t binframe_encodeEntry(const struct can_frame *frame, uint32_t timestamp, uint16_t sequence, uint8_t filter,
+                             uint8_t *out) {
+    uint8_t *p = out;
+    uint8_t dlc = frame->can_dlc & BINFRAME_DLC_MASK;
+    bool ext = (frame->can_id & CAN_EFF_FLAG) != 0;
+    bool rtr = (frame->can_id & CAN_RTR_FLAG) != 0;
+
+    *p++ = (ext ? BINFRAME_FLAG_EFF : 0) | (rtr ? BINFRAME_FLAG_RTR : 0)
+           | (filter != BINFRAME_NO_FILTER ? BINFRAME_FLAG_FILTER : 0)
+           | (sequence != BINFRAME_NO_SEQUENCE ? BINFRAME_FLAG_SEQUENCE : 0) | dlc;
+    if (ext) {
+        p = put_le(p, frame->can_id & CAN_EFF_MASK, 4);
+    } else {
+        p = put_le(p, frame->can_id & CAN_SFF_MASK, 2);
+    }
+    p = put_le(p, timestamp, 4);
+    if (sequence != BINFRAME_NO_SEQUENCE) {
+        *p++ = (uint8_t) sequence;
+    }
+    if (!rtr) {
+        for (uint8_t i = 0; i < dlc; i++) {
+            *p++ = frame->data[i];
+        }
+    }
+    if (filter != BINFRAME_NO_FILTER) {
+        *p++ = filter;
+    }
+    return p - out;
+}
+
+/*
+ * Closes a batch assembled in place: batch[0] is reserved for COBS,
+ * batch[1] and batch[2] hold type and count, the entries follow up to
+ * length. The crc and delimiter are appended, so the buffer needs
+ * BINFRAME_BATCH_TRAILER bytes past length, and the record is encoded
+ * where it is. Returns the encoded size.
+ */
+uint8_t binframe_finishBatch(uint8_t *batch, uint8_t length) {
+    uint8_t crc = 0;
+    for (uint8_t i = 1; i < length; i++) {
+        crc = _crc8_ccitt_update(crc, batch[i]);
+    }
+    batch[length++] = crc;
+
+    /* every byte stays where it is, a zero turns into the code of the
+     * block that follows it and batch[0] into the code of the first */
+    uint8_t codeIndex = 0;
+    uint8_t code = 1;
+    for (uint8_t i = 1; i < length; i++) {
+        if (batch[i] == 0) {
+            batch[codeIndex] = code;
+            codeIndex = i;
+            code = 1;
+        } else {
+            code++;
+        }
+    }
+    batch[codeIndex] = code;
+    batch[length++] = BINFRAME_DELIMITER;
+    return length;
+}
+
+/*
+ * Wraps an ASCII command response so it can share the link with frames.
+ * out must hold BINFRAME_MAX_ENCODED(BINFRAME_MAX_RESPONSE + 2) bytes.
+ */
+uint8_t binframe_encodeResponse(const char *response, uint8_t *out) {
+    uint8_t record[BINFRAME_MAX_RESPONSE + 2];
+    uint8_t length = 0;
+
+    record[length++] = BINFRAME_TYPE_RESPONSE;
+    while (*response != '\0' && length <= BINFRAME_MAX_RESPONSE) {
+        record[length++] = (uint8_t) *response++;
+    }
+    return binframe_finish(record, length, out);
+}
+
+static uint8_t binframe_finish(uint8_t *record, uint8_t length, uint8_t *out) {
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        crc = _crc8_ccitt_update(crc, record[i]);
+    }
+    record[length++] = crc;
+    return binframe_cobs(record, length, out);
+}
+
+/*
+ * Consistent overhead byte stuffing. Records are far shorter than 254
+ * bytes, so the 0xFF code for a full block never occurs.
+ */
+static uint8_t binframe_cobs(const uint8_t *in, uint8_t length, uint8_t *out) {
+    uint8_t codeIndex = 0;
+    uint8_t code = 1;
+    uint8_t o = 1;
+
+    for (uint8_t i = 0; i < length; i++) {
+        if (in[i] == 0) {
+            out[codeIndex] = code;
+            codeIndex = o++;
+            code = 1;
+        } else {
+            out[o++] = in[i];
+            code++;
+        }
+    }
+    out[codeIndex] = code;
+    out[o++] = BINFRAME_DELIMITER;
+    return o;
+}
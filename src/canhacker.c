@@ -7,6 +7,13 @@
 #include <util/delay.h>
 #include <string.h>
 #include "lib.h"
+#include "hex.h"
+#include "rxring.h"
+#include "txqueue.h"
+#include "schedule.h"
+#include "filter.h"
+#include "binframe.h"
+#include "millis.h"
 #include <avr/io.h>
 #include <util/atomic.h>
 #include <avr/interrupt.h>
@@ -16,19 +23,96 @@ static const char CR = '\r';
 static const char BEL = 7;
 static const uint16_t TIMESTAMP_LIMIT = 0xEA60;
 
+// the SJA1000 BTR values of the "s" command are relative to its 16 MHz clock
+static const uint32_t SJA1000_CLOCK = 16000000UL;
+
+// PeliCAN registers the W command understands
+enum SJA1000_REGISTER {
+    SJA1000_MOD = 0x00,
+    SJA1000_ACR0 = 0x10,
+    SJA1000_AMR0 = 0x14
+};
+static const uint8_t SJA1000_MOD_AFM = 0x08;
+
+// 'T' + 8 id + dlc + 16 data + 8 timestamp + filter + CR + NUL
+#define TRANSMIT_BUFFER_LENGTH 37
+
+// received frames are collected and written out in blocks of up to this size
+#ifndef OUTPUT_BATCH_SIZE
+#define OUTPUT_BATCH_SIZE 128
+#endif
+// a frame waits at most this long for more frames to join it
+#ifndef OUTPUT_FLUSH_MICROS
+#define OUTPUT_FLUSH_MICROS 1000
+#endif
+
+#if OUTPUT_BATCH_SIZE > BINFRAME_MAX_BATCH + 1
+#error OUTPUT_BATCH_SIZE too large for a binary batch record
+#endif
+
+enum TIMESTAMP {
+    TIMESTAMP_OFF,
+    TIMESTAMP_MILLIS, // Z1: CanHacker compatible, ms wrapping at 60000
+    TIMESTAMP_MICROS // Z2: 32 bit us wrapping every hour
+};
+
+// bits of the F status byte
+enum STATUS_FLAG {
+    STATUS_RX_FULL = 0x01, // receive ring full
+    STATUS_TX_FULL = 0x02, // transmit queue full, further t/T commands get BEL
+    STATUS_ERROR_WARNING = 0x04, // TEC or REC reached 96
+    STATUS_DATA_OVERRUN = 0x08, // frames lost since the last F
+    STATUS_TX_FAILED = 0x10, // queued frames dropped after transmit errors since the last F
+    STATUS_ERROR_PASSIVE = 0x20,
+    STATUS_BUS_ERROR = 0x80 // bus off
+};
+
 static enum CAN_CLOCK canClock = MCP_8MHZ;
-static bool timestampEnabled = false;
+static enum TIMESTAMP timestampMode = TIMESTAMP_OFF;
+static bool binaryMode = false;
+static bool batchMode = false;
+static bool filterReport = false;
 static bool listenOnly = false;
 static bool loopback = false;
 static enum CAN_SPEED bitrate;
-static bool isConnected = false;
+static bool customTiming = false;
+static struct bit_timing bitTiming;
+static volatile bool isConnected = false;
+static volatile uint8_t pendingInterrupts;
+// EFLG RX0OVR/RX1OVR seen by processInterrupt() since the last F
+static volatile uint8_t pendingOverruns;
+// frames txqueue_error() dropped since the last F
+static volatile bool pendingTxFailure;
+// sequence number of the next frame read from the MCP2515
+static uint8_t rxSequence;
 static FILE *stream;
 static FILE *debugStream;
-extern volatile unsigned long timer1_millis;
+static baudrate_handler_t baudrateHandler;
+static block_writer_t blockWriter;
+static block_reader_t blockReader;
+// command line being assembled, its CR is replaced by a NUL
+static char commandBuffer[CANHACKER_CMD_MAX_LENGTH + 1];
+static uint8_t commandLength;
+static bool commandOverflow;
+static uint16_t reportedOverflows;
+#ifdef MCP2515_RX_SPI_INTERRUPT
+// receive buffer startReadMessage() is reading, see canhacker_startRxBuffer()
+static enum RXBn rxReadBuffer;
+static uint8_t rxReadFull;
+static uint8_t rxReadFilter;
+static uint32_t rxReadTimestamp;
+#endif
+static uint8_t outputBatch[OUTPUT_BATCH_SIZE];
+static uint8_t outputLength;
+static uint32_t outputStarted;
+// SJA1000 ACR0..3, AMR0..3 and MOD.AFM, Lawicel defaults: dual filter, accept all
+static uint32_t acceptanceCode = 0;
+static uint32_t acceptanceMask = 0xFFFFFFFF;
+static bool singleFilter = false;
 
 enum COMMAND {
     COMMAND_SET_BITRATE = 'S', // set CAN bit rate
-    COMMAND_SET_BTR = 's', // set CAN bit rate via
+    COMMAND_SET_BTR = 's', // set CAN bit rate via SJA1000 BTR0/BTR1
     COMMAND_OPEN_CAN_CHAN = 'O', // open CAN channel
     COMMAND_CLOSE_CAN_CHAN = 'C', // close CAN channel
     COMMAND_SEND_11BIT_ID = 't', // send CAN message with 11bit ID
@@ -46,21 +130,55 @@ enum COMMAND {
     COMMAND_READ_ALCR = 'A', // read Arbritation Lost Capture Register
     COMMAND_READ_REG = 'G', // read register conten from SJA1000
     COMMAND_WRITE_REG = 'W', // write register content to SJA1000
-    COMMAND_LISTEN_ONLY = 'L'  // switch to listen only mode
+    COMMAND_LISTEN_ONLY = 'L', // switch to listen only mode
+    COMMAND_BINARY_MODE = 'B', // select ASCII (B0) or binary (B1) frame protocol
+    COMMAND_SET_UART_BAUD = 'U', // set serial baud rate
+    COMMAND_SCHEDULE = 'Y', // set or remove a cyclic frame
+    COMMAND_FILTER = 'f', // add an accepted id or id range
+    COMMAND_FILTER_HIT = 'H', // report the MCP2515 filter of each received frame (H1) or not (H0)
+    COMMAND_RECEIVE_ORDER = 'K' // keep bus order with two hardware filters (K1) or use all six (K0)
+};
+
+// Lawicel U0..U6, followed by the rates only a 14.7456 MHz crystal reaches
+static const uint32_t uartBaudrates[] PROGMEM = {
+    230400, 115200, 57600, 38400, 19200, 9600, 2400, 460800, 921600, 1843200
 };
 
 static enum ERROR canhacker_parseTransmit(const char *buffer, int length, struct can_frame *frame);
 
-static enum ERROR canhacker_createTransmit(const struct can_frame *frame, char *buffer, int length);
+static enum ERROR canhacker_createTransmit(const struct can_frame *frame, uint32_t timestamp, uint8_t filter,
+                                          char *buffer, int length);
+
+static enum ERROR canhacker_receiveRxFrame(const struct rx_frame *rx);
+
+static enum ERROR canhacker_queueOutput(const struct can_frame *frame, uint32_t timestamp, uint16_t sequence,
+                                        uint8_t filter);
+
+static enum ERROR canhacker_flushOutput(void);
 
-static uint16_t canhacker_getTimestamp(void);
+static uint32_t canhacker_getTimestamp(void);
 
-static enum ERROR canhacker_setFilter(uint32_t filter);
+static enum ERROR canhacker_readRxBuffer(enum RXBn rxBuffer, uint8_t filter, uint32_t timestamp);
 
-static enum ERROR canhacker_setFilterMask(uint32_t mask);
+static enum ERROR canhacker_queueRxFrame(struct rx_frame *slot, const struct can_frame *frame, uint8_t filter,
+                                         uint32_t timestamp);
+
+#ifdef MCP2515_RX_SPI_INTERRUPT
+static void canhacker_startRxBuffer(enum RXBn rxBuffer, uint8_t full, uint32_t timestamp);
+
+static void canhacker_rxBufferRead(void);
+#endif
+
+static uint8_t canhacker_getFilterHit(enum RXBn rxBuffer);
+
+static enum ERROR canhacker_applyFilter(void);
+
+static enum ERROR canhacker_applySja1000Filter(void);
 
 static enum ERROR canhacker_connectCan(void);
 
+static enum ERROR canhacker_setOperationMode(void);
+
 static enum ERROR canhacker_disconnectCan(void);
 
 static bool canhacker_isConnected(void);
@@ -71,9 +189,9 @@ static enum ERROR canhacker_writeStream(char character);
 
 static enum ERROR canhacker_writeStreamFromBuffer(const char *buffer);
 
-static enum ERROR canhacker_writeDebugStream(char character);
+static enum ERROR canhacker_writeStreamRaw(const uint8_t *buffer, size_t size);
 
-static enum ERROR canhacker_writeDebugStreamFromBuffer(const char *buffer);
+static enum ERROR canhacker_writeDebugStream(char character);
 
 static enum ERROR canhacker_writeDebugStreamInt(int buffer);
 
@@ -83,6 +201,8 @@ static enum ERROR canhacker_writePgmDebugStream(PGM_P ifsh);
 
 static enum ERROR canhacker_receiveSetBitrateCommand(const char *buffer, int length);
 
+static enum ERROR canhacker_receiveSetBtrCommand(const char *buffer, int length);
+
 static enum ERROR canhacker_receiveTransmitCommand(const char *buffer, int length);
 
 static enum ERROR canhacker_receiveTimestampCommand(const char *buffer, int length);
@@ -97,41 +217,27 @@ static enum ERROR canhacker_receiveSetAcrCommand(const char *buffer, int length)
 
 static enum ERROR canhacker_receiveSetAmrCommand(const char *buffer, int length);
 
-static unsigned long millis(void);
+static enum ERROR canhacker_receiveBinaryModeCommand(const char *buffer, int length);
 
-const char hex_asc_upper[] = "0123456789ABCDEF";
+static enum ERROR canhacker_receiveSetUartBaudCommand(const char *buffer, int length);
 
-#define hex_asc_upper_lo(x)    hex_asc_upper[((x) & 0x0F)]
-#define hex_asc_upper_hi(x)    hex_asc_upper[((x) & 0xF0) >> 4]
+static enum ERROR canhacker_receiveReadStatusCommand(const char *buffer, int length);
 
-unsigned long millis() {
-    unsigned long millis_return;
-    ENTER_CRITICAL(R);
-    millis_return = timer1_millis;
-    EXIT_CRITICAL(R);
-    return millis_return;
-}
+static enum ERROR canhacker_receiveScheduleCommand(const char *buffer, int length);
 
-static inline void put_hex_byte(char *buf, uint8_t byte) {
-    buf[0] = hex_asc_upper_hi(byte);
-    buf[1] = hex_asc_upper_lo(byte);
-}
+static enum ERROR canhacker_receiveFilterCommand(const char *buffer, int length);
 
-static inline void put_id(char *buf, int end_offset, canid_t id) {
-    /* build 3 (SFF) or 8 (EFF) digit CAN identifier */
-    while (end_offset >= 0) {
-        buf[end_offset--] = hex_asc_upper[id & 0xF];
-        id >>= 4;
-    }
-}
+static enum ERROR canhacker_receiveWriteRegisterCommand(const char *buffer, int length);
 
-#define put_sff_id(buf, id) put_id(buf, 2, id)
-#define put_eff_id(buf, id) put_id(buf, 7, id)
+static enum ERROR canhacker_receiveFilterHitCommand(const char *buffer, int length);
+static enum ERROR canhacker_receiveReceiveOrderCommand(const char *buffer, int length);
 
 void CanHacker(FILE *_stream, FILE *_debugStream) {
     stream = _stream;
     debugStream = _debugStream;
     canhacker_writePgmDebugStream(PSTR("Initialization\n"));
+    rxring_init();
+    schedule_init();
     MCP2515();
     reset();
     setConfigMode();
@@ -145,14 +251,58 @@ void setClock(enum CAN_CLOCK clock) {
     canClock = clock;
 }
 
+void setBaudrateHandler(baudrate_handler_t handler) {
+    baudrateHandler = handler;
+}
+
+/*
+ * With a block writer every frame and response reaches the serial driver
+ * in one call instead of one stdio put per character.
+ */
+void setBlockWriter(block_writer_t writer) {
+    blockWriter = writer;
+}
+
+/*
+ * Source of the command lines pollCommand() assembles, read without
+ * blocking up to the next CR.
+ */
+void setBlockReader(block_reader_t reader) {
+    blockReader = reader;
+}
+
 static enum ERROR canhacker_connectCan() {
-    enum MCP2515_ERROR error = setBitrateWithCANClock(bitrate, canClock);
+    enum MCP2515_ERROR error = customTiming
+            ? setBitTiming(&bitTiming)
+            : setBitrateWithCANClock(bitrate, canClock);
     if (error != MCP2515_ERROR_OK) {
         canhacker_writePgmDebugStream(PSTR("setBitRate error:\n"));
         canhacker_writeDebugStreamInt((int) error);
         canhacker_writeDebugStream('\n');
         return ERROR_MCP2515_INIT_BITRATE;
     }
+    enum ERROR result = canhacker_setOperationMode();
+    if (result != ERROR_OK) {
+        return result;
+    }
+    rxring_init();
+    txqueue_init();
+    reportedOverflows = 0;
+    pendingOverruns = 0;
+    pendingTxFailure = false;
+    rxSequence = 0;
+    isConnected = true;
+    if (!listenOnly) {
+        schedule_start(millis());
+    }
+    return ERROR_OK;
+}
+
+/*
+ * Leaves configuration mode for the mode the channel was opened in.
+ */
+static enum ERROR canhacker_setOperationMode() {
+    enum MCP2515_ERROR error;
     if (loopback) {
         error = setLoopbackMode();
     } else if (listenOnly) {
@@ -163,11 +313,11 @@ static enum ERROR canhacker_connectCan() {
     if (error != MCP2515_ERROR_OK) {
         return ERROR_MCP2515_INIT_SET_MODE;
     }
-    isConnected = true;
     return ERROR_OK;
 }
 
 static enum ERROR canhacker_disconnectCan() {
+    schedule_stop();
     isConnected = false;
     setConfigMode();
     return ERROR_OK;
@@ -177,47 +327,152 @@ static bool canhacker_isConnected() {
     return isConnected;
 }
 
+/*
+ * Queues the frame for ISR(PCINT1_vect) to load into a free TX buffer.
+ */
 static enum ERROR canhacker_writeCan(const struct can_frame *frame) {
-    if (sendMessage(frame) != MCP2515_ERROR_OK) {
-        return ERROR_MCP2515_SEND;
+    if (!txqueue_push(frame)) {
+        return txqueue_full() ? ERROR_BUFFER_OVERFLOW : ERROR_MCP2515_SEND;
     }
     return ERROR_OK;
 }
 
+/*
+ * Main loop side of the receive pipeline: formats and ships every frame
+ * captured by processInterrupt() and reports deferred MCP2515 events.
+ */
 enum ERROR pollReceiveCan() {
-    if (!isConnected) {
-        return ERROR_OK;
-    }
-    while (checkReceive()) {
-        struct can_frame frame;
-        if (readMessage(&frame) != MCP2515_ERROR_OK) {
-            return ERROR_MCP2515_READ;
+    struct rx_frame *rx;
+    while ((rx = rxring_peek()) != NULL) {
+        enum ERROR error = canhacker_receiveRxFrame(rx);
+        rxring_release();
+        if (error != ERROR_OK) {
+            return error;
         }
-        enum ERROR error = receiveCanFrame(&frame);
+    }
+
+    if (outputLength != 0 && micros() - outputStarted >= OUTPUT_FLUSH_MICROS) {
+        enum ERROR error = canhacker_flushOutput();
         if (error != ERROR_OK) {
             return error;
         }
     }
+
+    uint8_t irq;
+    ENTER_CRITICAL(R);
+    irq = pendingInterrupts;
+    pendingInterrupts = 0;
+    EXIT_CRITICAL(R);
+
+    if (irq & CANINTF_WAKIF) {
+        canhacker_writePgmDebugStream(PSTR("MCP_WAKIF\n"));
+    }
+    if (irq & CANINTF_ERRIF) {
+        canhacker_writePgmDebugStream(PSTR("ERRIF\n"));
+    }
+    if (irq & CANINTF_MERRF) {
+        canhacker_writePgmDebugStream(PSTR("MERRF\n"));
+    }
     return ERROR_OK;
 }
 
+/*
+ * Drains one MCP2515 receive buffer into the frame ring. Called from the
+ * PCINT1 handler; a frame that does not fit is still read out so the
+ * buffer is freed for the next one.
+ */
 enum ERROR receiveCan(enum RXBn rxBuffer) {
+    return canhacker_readRxBuffer(rxBuffer, RX_FILTER_UNKNOWN, canhacker_getTimestamp());
+}
+
+static enum ERROR canhacker_readRxBuffer(enum RXBn rxBuffer, uint8_t filter, uint32_t timestamp) {
     if (!isConnected) {
         return ERROR_OK;
     }
-    struct can_frame frame;
-    enum MCP2515_ERROR result = readMessageThroughRXBn(rxBuffer, &frame);
+    // read straight into the ring; only an accepted frame that finds it
+    // full counts as lost
+    struct rx_frame *slot = rxring_reserve();
+    struct can_frame dropped;
+    struct can_frame *frame = (slot != NULL) ? &slot->frame : &dropped;
+    enum MCP2515_ERROR result = readMessageThroughRXBn(rxBuffer, frame);
     if (result == MCP2515_ERROR_NOMSG) {
         return ERROR_OK;
     }
     if (result != MCP2515_ERROR_OK) {
         return ERROR_MCP2515_READ;
     }
-    return receiveCanFrame(&frame);
+    return canhacker_queueRxFrame(slot, frame, filter, timestamp);
+}
+
+/*
+ * Commits a frame read into slot, or into a scratch frame when slot is
+ * NULL because the ring was full.
+ */
+static enum ERROR canhacker_queueRxFrame(struct rx_frame *slot, const struct can_frame *frame, uint8_t filter,
+                                         uint32_t timestamp) {
+    if (!filter_accepts(frame)) {
+        return ERROR_OK;
+    }
+    // frames lost to a full ring still take a number, the host sees the gap
+    uint8_t sequence = rxSequence++;
+    if (slot == NULL) {
+        rxring_drop();
+        return ERROR_BUFFER_OVERFLOW;
+    }
+    slot->timestamp = timestamp;
+    slot->filter = filter;
+    slot->sequence = sequence;
+    rxring_commit();
+    return ERROR_OK;
 }
 
-static uint16_t canhacker_getTimestamp() {
-    return millis() % TIMESTAMP_LIMIT;
+#ifdef MCP2515_RX_SPI_INTERRUPT
+/*
+ * Leaves rxBuffer to the SPI interrupt, which reads it while the main
+ * loop formats the frames before it; canhacker_rxBufferRead() takes over
+ * when it is done. full holds the RXnBF pins as they were at timestamp.
+ */
+static void canhacker_startRxBuffer(enum RXBn rxBuffer, uint8_t full, uint32_t timestamp) {
+    rxReadBuffer = rxBuffer;
+    rxReadFull = full;
+    rxReadFilter = canhacker_getFilterHit(rxBuffer);
+    rxReadTimestamp = timestamp;
+    startReadMessage(rxBuffer, canhacker_rxBufferRead);
+}
+
+/*
+ * Runs from ISR(SPI_STC_vect) once the buffer is read. RXB1 goes right
+ * after RXB0 like in processInterrupt(), then the rest of the drain runs
+ * as in ISR(PCINT1_vect), with interrupts enabled.
+ */
+static void canhacker_rxBufferRead(void) {
+    if (isConnected) {
+        struct rx_frame *slot = rxring_reserve();
+        struct can_frame dropped;
+        struct can_frame *frame = (slot != NULL) ? &slot->frame : &dropped;
+        finishReadMessage(frame);
+        canhacker_queueRxFrame(slot, frame, rxReadFilter, rxReadTimestamp);
+    }
+    if (rxReadBuffer == RXB0) {
+        uint8_t now = getFullRxBuffers();
+        if (isConnected && (now & CANINTF_RX1IF)) {
+            // RXB1 filled while RXB0 was read, after the timestamp
+            uint32_t timestamp = (rxReadFull & CANINTF_RX1IF) ? rxReadTimestamp : canhacker_getTimestamp();
+            canhacker_startRxBuffer(RXB1, now, timestamp);
+            return;
+        }
+    }
+    sei();
+    bool done = serviceInterrupt();
+    cli();
+    if (done) {
+        PCICR |= (1 << PCIE1);
+    }
+}
+#endif
+
+static uint32_t canhacker_getTimestamp() {
+    return micros();
 }
 
 static enum ERROR canhacker_receiveSetBitrateCommand(const char *buffer, int length) {
@@ -263,12 +518,16 @@ static enum ERROR canhacker_receiveSetBitrateCommand(const char *buffer, int len
             bitrate = CAN_500KBPS;
             break;
         case '7':
-            canhacker_writePgmDebugStream(PSTR("Bitrate 7 is not supported\n"));
-            canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
-            canhacker_writeDebugStream('\n');
-            canhacker_writeStream(BEL);
-            return ERROR_INVALID_COMMAND;
-            break;
+            if (calculateBitTiming(canClock, 800000UL, 800, 1, false, &bitTiming) != MCP2515_ERROR_OK) {
+                canhacker_writePgmDebugStream(PSTR("Bitrate 7 is not supported\n"));
+                canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+                canhacker_writeDebugStream('\n');
+                canhacker_writeStream(BEL);
+                return ERROR_INVALID_COMMAND;
+            }
+            canhacker_writePgmDebugStream(PSTR("Set bitrate 800KBPS\n"));
+            customTiming = true;
+            return canhacker_writeStream(CR);
         case '8':
             canhacker_writePgmDebugStream(PSTR("Set bitrate 1000KBPS\n"));
             bitrate = CAN_1000KBPS;
@@ -281,77 +540,201 @@ static enum ERROR canhacker_receiveSetBitrateCommand(const char *buffer, int len
             return ERROR_INVALID_COMMAND;
             break;
     }
+    customTiming = false;
     return canhacker_writeStream(CR);
 }
 
+/*
+ * "sxxyy" with SJA1000 BTR0 and BTR1. The bitrate and sample point they
+ * describe are recomputed for the clock of the MCP2515, so non-standard
+ * bitrates work with any crystal that can reach them.
+ */
+static enum ERROR canhacker_receiveSetBtrCommand(const char *buffer, int length) {
+    if (isConnected) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("\"SET_BTR command cannot be called while connected\\n\""));
+        return ERROR_CONNECTED;
+    }
+    if (length != 5) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("SET_BTR command must be 5 bytes long\n"));
+        canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+        canhacker_writeDebugStream('\n');
+        return ERROR_INVALID_COMMAND;
+    }
+    uint8_t btr0;
+    uint8_t btr1;
+    if (!hex_getByte(&buffer[1], &btr0) || !hex_getByte(&buffer[3], &btr1)) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("SET_BTR command must be hex\n"));
+        return ERROR_INVALID_COMMAND;
+    }
+
+    uint8_t brp = (btr0 & 0x3F) + 1;
+    uint8_t sjw = (btr0 >> 6) + 1;
+    uint8_t tseg1 = (btr1 & 0x0F) + 1;
+    uint8_t tseg2 = ((btr1 >> 4) & 0x07) + 1;
+    bool tripleSample = (btr1 & 0x80) != 0;
+    uint8_t tq = 1 + tseg1 + tseg2;
+
+    uint32_t rate = SJA1000_CLOCK / (2UL * brp * tq);
+    uint16_t samplePoint = (uint16_t) (1 + tseg1) * 1000 / tq;
+    if (calculateBitTiming(canClock, rate, samplePoint, sjw, tripleSample, &bitTiming) != MCP2515_ERROR_OK) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("SET_BTR bitrate cannot be reached\n"));
+        canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+        canhacker_writeDebugStream('\n');
+        return ERROR_INVALID_COMMAND;
+    }
+    customTiming = true;
+    return canhacker_writeStream(CR);
+}
+
+/*
+ * Body of ISR(PCINT1_vect), entered with the pin change interrupt masked:
+ * drains the MCP2515 while its INT line is low, then loads the cyclic
+ * frames that fell due meanwhile. Returns false when it left a receive
+ * buffer read running on the SPI interrupt; the pin change interrupt then
+ * stays masked and the read calls this again when it is done.
+ */
+bool serviceInterrupt() {
+    while (isInterruptAsserted()) {
+        PCIFR = (1 << PCIF1);
+        processInterrupt();
+#ifdef MCP2515_RX_SPI_INTERRUPT
+        if (readMessageRunning()) {
+            return false;
+        }
+#endif
+    }
+    txqueue_service();
+    return true;
+}
+
+/*
+ * Interrupt side of the receive pipeline, called from ISR(PCINT1_vect)
+ * while the MCP2515 INT line is low. Only moves frames into the ring and
+ * acknowledges the MCP2515; reporting is left to pollReceiveCan().
+ */
 enum ERROR processInterrupt() {
+    // taken before any SPI traffic, as close to the INT edge as possible
+    uint32_t timestamp = canhacker_getTimestamp();
     if (!isConnected) {
+        clearInterrupts();
         return ERROR_OK;
     }
-    uint8_t irq = getInterrupts();
-    if (irq & CANINTF_ERRIF) {
-        clearRXnOVR();
+    // the RXnBF pins name the full buffers without SPI traffic
+    uint8_t full = getFullRxBuffers();
+#ifdef MCP2515_RX_SPI_INTERRUPT
+    if (full != 0) {
+        // one buffer at a time and RXB0 first, as below
+        canhacker_startRxBuffer((full & CANINTF_RX0IF) ? RXB0 : RXB1, full, timestamp);
+        return ERROR_OK;
     }
-    if (irq & CANINTF_RX0IF) {
-        enum ERROR error = receiveCan(RXB0);
-        if (error != ERROR_OK) {
-            return error;
+#else
+    if (full != 0) {
+        // RXB0 takes a new frame as soon as it is read, so RXB0 goes first
+        // and a full RXB1 right after it, before RXB0 is looked at again.
+        // A frame that rolled over into RXB1 (BUKT, RXF0/RXF1) arrived
+        // while RXB0 was full and is newer than it, so with rollover alone
+        // frames reach the ring in bus order; ordered filter plans (K1)
+        // leave RXB1 nothing else. After K0 a direct RXF2..RXF5 hit in
+        // RXB1 does not depend on RXB0: when both buffers filled before
+        // this call, the MCP2515 has no record of which came first and
+        // RXB0 is taken as the older one.
+        enum ERROR error = ERROR_OK;
+        uint32_t rx1Timestamp = timestamp;
+        if (full & CANINTF_RX0IF) {
+            error = canhacker_readRxBuffer(RXB0, canhacker_getFilterHit(RXB0), timestamp);
+            uint8_t now = getFullRxBuffers();
+            if ((now & ~full) & CANINTF_RX1IF) {
+                // RXB1 filled while RXB0 was read, after timestamp
+                rx1Timestamp = canhacker_getTimestamp();
+            }
+            full = now;
         }
+        if (full & CANINTF_RX1IF) {
+            enum ERROR rx1Error = canhacker_readRxBuffer(RXB1, canhacker_getFilterHit(RXB1), rx1Timestamp);
+            if (error == ERROR_OK) {
+                error = rx1Error;
+            }
+        }
+        return error;
     }
-    if (irq & CANINTF_RX1IF) {
-        enum ERROR error = receiveCan(RXB1);
-        if (error != ERROR_OK) {
-            return error;
+#endif
+
+    uint8_t irq = getInterrupts();
+    if (irq & (CANINTF_TX0IF | CANINTF_TX1IF | CANINTF_TX2IF)) {
+        clearTXnIF(irq);
+        txqueue_transmitted(irq);
+    }
+    if (irq & (CANINTF_ERRIF | CANINTF_MERRF)) {
+        // MERRF follows every failed attempt, ERRIF the error state change
+        uint8_t eflg = (irq & CANINTF_ERRIF) ? acknowledgeErrors() : getErrorFlags();
+        pendingOverruns |= eflg & (EFLG_RX0OVR | EFLG_RX1OVR);
+        if (txqueue_error(eflg) != 0) {
+            pendingTxFailure = true;
         }
     }
     if (irq & CANINTF_WAKIF) {
-        fprintf_P(debugStream, "MCP_WAKIF\r\n");
-        clearInterrupts();
-        fflush(debugStream);
-    }
-    if (irq & CANINTF_ERRIF) {
-        fprintf_P(debugStream, "ERRIF\r\n");
-        clearMERR();
-        fflush(debugStream);
+        clearWAKIF();
     }
     if (irq & CANINTF_MERRF) {
-        fprintf_P(debugStream, "MERRF\r\n");
-        clearInterrupts();
-        fflush(debugStream);
+        clearMERR();
     }
+    pendingInterrupts |= irq & (CANINTF_ERRIF | CANINTF_WAKIF | CANINTF_MERRF);
     return ERROR_OK;
 }
 
-static enum ERROR canhacker_setFilter(uint32_t filter) {
-    if (isConnected) {
-        canhacker_writePgmDebugStream(PSTR("Filter cannot be set while connected\n"));
-        return ERROR_CONNECTED;
+/*
+ * Filter that accepted the frame in rxBuffer, for H1; read before the
+ * buffer is, READ RX BUFFER frees it. RX STATUS reports RXB0 while both
+ * buffers are full, so RXB1 then needs RXB1CTRL.
+ */
+static uint8_t canhacker_getFilterHit(enum RXBn rxBuffer) {
+    if (!filterReport) {
+        return RX_FILTER_UNKNOWN;
     }
-    enum RXF filters[] = {RXF0, RXF1, RXF2, RXF3, RXF4, RXF5};
-    for (uint8_t i = 0; i < 6; i++) {
-        enum MCP2515_ERROR result = setFilter(filters[i], false, filter);
-        if (result != MCP2515_ERROR_OK) {
-            return ERROR_MCP2515_FILTER;
-        }
+    uint8_t rxStatus = getRxStatus();
+    if (rxBuffer == RXB1 && (rxStatus & RXSTATUS_RXB0)) {
+        return getFilterHit(RXB1);
     }
-    return ERROR_OK;
+    uint8_t filter = rxStatus & RXSTATUS_FILHIT_MASK;
+    if (filter >= RXSTATUS_ROLLOVER) {
+        filter -= RXSTATUS_ROLLOVER;
+    }
+    return filter;
 }
 
-static enum ERROR canhacker_setFilterMask(uint32_t mask) {
-    if (isConnected) {
-        canhacker_writePgmDebugStream(PSTR("Filter mask cannot be set while connected\n"));
-        return ERROR_CONNECTED;
-    }
-    enum MASK masks[] = {MASK0, MASK1};
-    for (uint8_t i = 0; i < 2; i++) {
-        enum MCP2515_ERROR result = setFilterMask(masks[i], false, mask);
-        if (result != MCP2515_ERROR_OK) {
-            return ERROR_MCP2515_FILTER;
+/*
+ * Plans and writes the MCP2515 filters, which only works in configuration
+ * mode. On an open channel only the MCP2515 mode changes: the MCP2515
+ * finishes its pending transmissions before it enters configuration mode,
+ * and the transmit queue, the received frames, the schedule and the
+ * sequence numbers carry on as they were.
+ */
+static enum ERROR canhacker_applyFilter() {
+    if (filter_apply() != MCP2515_ERROR_OK) {
+        if (canhacker_isConnected()) {
+            canhacker_setOperationMode();
         }
+        return ERROR_MCP2515_FILTER;
+    }
+    if (canhacker_isConnected()) {
+        return canhacker_setOperationMode();
     }
     return ERROR_OK;
 }
 
+/*
+ * M, m and W set the SJA1000 registers CanHacker/SLCAN tools know; the
+ * filter rules are rebuilt from them.
+ */
+static enum ERROR canhacker_applySja1000Filter() {
+    filter_setSja1000(acceptanceCode, acceptanceMask, singleFilter);
+    return canhacker_applyFilter();
+}
+
 static enum ERROR canhacker_writeStream(char character) {
     char str[2];
     str[0] = character;
@@ -359,23 +742,38 @@ static enum ERROR canhacker_writeStream(char character) {
     return canhacker_writeStreamFromBuffer(str);
 }
 
+/*
+ * Responses go out right away, behind the frames received before them.
+ */
 static enum ERROR canhacker_writeStreamFromBuffer(const char *buffer) {
-    size_t printed = fputs(buffer, stream);
-    if (printed != strlen(buffer))
+    canhacker_flushOutput();
+    if (binaryMode) {
+        uint8_t out[BINFRAME_MAX_ENCODED(BINFRAME_MAX_RESPONSE + 2)];
+        return canhacker_writeStreamRaw(out, binframe_encodeResponse(buffer, out));
+    }
+    return canhacker_writeStreamRaw((const uint8_t *) buffer, strlen(buffer));
+}
+
+static enum ERROR canhacker_writeStreamRaw(const uint8_t *buffer, size_t size) {
+    if (blockWriter != NULL) {
+        blockWriter(buffer, size);
+        return ERROR_OK;
+    }
+    if (fwrite(buffer, sizeof buffer[0], size, stream) != size)
         return ERROR_SERIAL_TX_OVERRUN;
     return ERROR_OK;
 }
 
-static enum ERROR canhacker_writeDebugStream(const char character) {
+static enum ERROR canhacker_writePgmDebugStream(PGM_P ifsh) {
     if (debugStream != NULL) {
-        putc(character, debugStream);
+        fputs_P(ifsh, debugStream);
     }
     return ERROR_OK;
 }
 
-static enum ERROR canhacker_writeDebugStreamFromBuffer(const char *buffer) {
+static enum ERROR canhacker_writeDebugStream(const char character) {
     if (debugStream != NULL) {
-        fputs(buffer, debugStream);
+        putc(character, debugStream);
     }
     return ERROR_OK;
 }
@@ -421,38 +819,156 @@ enum ERROR receiveCommand(const char *buffer, int length) {
         case COMMAND_SET_AMR:
             return canhacker_receiveSetAmrCommand(buffer, length);
         case COMMAND_SET_BTR:
-            if (isConnected) {
-                canhacker_writeStream(BEL);
-                canhacker_writePgmDebugStream(PSTR("\"SET_BTR command cannot be called while connected\\n\""));
-                return ERROR_CONNECTED;
-            }
-            canhacker_writePgmDebugStream("SET_BTR not supported\n");
-            return canhacker_writeStream(CR);
+            return canhacker_receiveSetBtrCommand(buffer, length);
         case COMMAND_LISTEN_ONLY:
             return canhacker_receiveListenOnlyCommand(buffer, length);
         case COMMAND_TIME_STAMP:
             return canhacker_receiveTimestampCommand(buffer, length);
+        case COMMAND_BINARY_MODE:
+            return canhacker_receiveBinaryModeCommand(buffer, length);
+        case COMMAND_SET_UART_BAUD:
+            return canhacker_receiveSetUartBaudCommand(buffer, length);
+        case COMMAND_SCHEDULE:
+            return canhacker_receiveScheduleCommand(buffer, length);
+        case COMMAND_FILTER:
+            return canhacker_receiveFilterCommand(buffer, length);
         case COMMAND_WRITE_REG:
+            return canhacker_receiveWriteRegisterCommand(buffer, length);
+        case COMMAND_FILTER_HIT:
+            return canhacker_receiveFilterHitCommand(buffer, length);
+        case COMMAND_RECEIVE_ORDER:
+            return canhacker_receiveReceiveOrderCommand(buffer, length);
         case COMMAND_READ_REG: {
             return canhacker_writeStream(CR);
         }
         case COMMAND_READ_STATUS:
+            return canhacker_receiveReadStatusCommand(buffer, length);
         case COMMAND_READ_ECR:
         case COMMAND_READ_ALCR: {
             if (!isConnected) {
                 canhacker_writePgmDebugStream(PSTR("Read status, ecr, alcr while not connected\n"));
             }
+            break;
         }
     }
+    canhacker_writeStream(BEL);
+    return ERROR_UNKNOWN_COMMAND;
+}
+
+/*
+ * Takes what the reader has up to the next CR into the command line and
+ * runs the line once it is complete. At most one command per call, so
+ * the main loop gets back to the received frames in between. A line
+ * longer than CANHACKER_CMD_MAX_LENGTH is dropped up to its CR and
+ * answered with BEL.
+ */
+enum ERROR pollCommand() {
+    if (blockReader == NULL) {
+        return ERROR_OK;
+    }
+    uint8_t room = sizeof commandBuffer - commandLength;
+    uint8_t read = blockReader((uint8_t *) &commandBuffer[commandLength], room, CR);
+    if (read == 0) {
+        return ERROR_OK;
+    }
+    commandLength += read;
+    if (commandBuffer[commandLength - 1] != CR) {
+        if (commandLength == sizeof commandBuffer) {
+            // keep reading over the buffer until the CR turns up
+            commandOverflow = true;
+            commandLength = 0;
+        }
+        return ERROR_OK;
+    }
+
+    uint8_t length = commandLength - 1;
+    commandBuffer[length] = '\0';
+    commandLength = 0;
+    if (commandOverflow) {
+        commandOverflow = false;
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Command too long\n"));
+        return ERROR_INVALID_COMMAND;
+    }
+    // hosts that end lines with CR LF leave the LF in front of the next command
+    const char *command = commandBuffer;
+    while (length != 0 && *command == '\n') {
+        command++;
+        length--;
+    }
+    if (length == 0) {
+        return ERROR_OK;
+    }
+    return receiveCommand(command, length);
 }
 
 enum ERROR receiveCanFrame(const struct can_frame *frame) {
-    char out[35];
-    enum ERROR error = canhacker_createTransmit(frame, out, 35);
-    if (error != ERROR_OK) {
-        return error;
+    return canhacker_queueOutput(frame, canhacker_getTimestamp(), BINFRAME_NO_SEQUENCE, RX_FILTER_UNKNOWN);
+}
+
+static enum ERROR canhacker_receiveRxFrame(const struct rx_frame *rx) {
+    return canhacker_queueOutput(&rx->frame, rx->timestamp, rx->sequence, rx->filter);
+}
+
+/*
+ * Formats the frame straight into the output batch; a batch that has no
+ * room for one more frame of the longest kind is written out first.
+ */
+static enum ERROR canhacker_queueOutput(const struct can_frame *frame, const uint32_t timestamp, uint16_t sequence,
+                                        uint8_t filter) {
+    uint8_t needed = batchMode ? BINFRAME_MAX_ENTRY + BINFRAME_BATCH_TRAILER
+                               : binaryMode ? BINFRAME_MAX_ENCODED(BINFRAME_MAX_RECORD) : TRANSMIT_BUFFER_LENGTH;
+    if (OUTPUT_BATCH_SIZE - outputLength < needed) {
+        enum ERROR error = canhacker_flushOutput();
+        if (error != ERROR_OK) {
+            return error;
+        }
     }
-    return canhacker_writeStreamFromBuffer(out);
+    if (outputLength == 0) {
+        outputStarted = micros();
+        if (batchMode) {
+            outputBatch[1] = BINFRAME_TYPE_BATCH;
+            outputBatch[2] = 0;
+            outputLength = BINFRAME_BATCH_HEADER;
+        }
+    }
+    uint8_t *out = &outputBatch[outputLength];
+    if (!filterReport) {
+        filter = BINFRAME_NO_FILTER;
+    }
+    if (batchMode) {
+        outputLength += binframe_encodeEntry(frame, timestamp, sequence, filter, out);
+        outputBatch[2]++;
+    } else if (binaryMode) {
+        outputLength += binframe_encodeCan(frame, timestamp, sequence, filter, out);
+    } else {
+        enum ERROR error = canhacker_createTransmit(frame, timestamp, filter, (char *) out, TRANSMIT_BUFFER_LENGTH);
+        if (error != ERROR_OK) {
+            return error;
+        }
+        outputLength += strlen((const char *) out);
+    }
+    return ERROR_OK;
+}
+
+static enum ERROR canhacker_flushOutput() {
+    uint8_t length = outputLength;
+    if (length == 0) {
+        return ERROR_OK;
+    }
+    if (batchMode) {
+        length = binframe_finishBatch(outputBatch, length);
+    }
+    outputLength = 0;
+    return canhacker_writeStreamRaw(outputBatch, length);
+}
+
+/*
+ * Writes out the frames collected so far without waiting for the batch
+ * to fill or time out.
+ */
+enum ERROR flushReceiveCan() {
+    return canhacker_flushOutput();
 }
 
 static enum ERROR canhacker_parseTransmit(const char *buffer, int length, struct can_frame *frame) {
@@ -486,12 +1002,15 @@ static enum ERROR canhacker_parseTransmit(const char *buffer, int length, struct
     }
     int offset = 1;
 
-    canid_t id = 0;
+    uint32_t id;
     int idChars = isExtended ? 8 : 3;
-    for (int i = 0; i < idChars; i++) {
-        id <<= 4;
-        id += hexCharToByte(buffer[offset++]);
+    if (length < offset + idChars + 1 || !hex_get(&buffer[offset], idChars, &id)) {
+        canhacker_writePgmDebugStream(PSTR("Invalid id in transmit command\n"));
+        canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+        canhacker_writeDebugStream('\n');
+        return ERROR_INVALID_COMMAND;
     }
+    offset += idChars;
     if (isRTR) {
         id |= CAN_RTR_FLAG;
     }
@@ -499,7 +1018,7 @@ static enum ERROR canhacker_parseTransmit(const char *buffer, int length, struct
         id |= CAN_EFF_FLAG;
     }
     frame->can_id = id;
-    uint8_t dlc = hexCharToByte(buffer[offset++]);
+    uint8_t dlc = hex_nibble(buffer[offset++]);
     if (dlc > 8) {
         canhacker_writePgmDebugStream(PSTR("DLC > 8\n"));
         canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
@@ -514,16 +1033,30 @@ static enum ERROR canhacker_parseTransmit(const char *buffer, int length, struct
     }
     frame->can_dlc = dlc;
     if (!isRTR) {
+        if (length < offset + 2 * dlc) {
+            canhacker_writePgmDebugStream(PSTR("Transmit message shorter than DLC\n"));
+            canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+            canhacker_writeDebugStream('\n');
+            return ERROR_INVALID_COMMAND;
+        }
         for (int i = 0; i < dlc; i++) {
-            char hiHex = buffer[offset++];
-            char loHex = buffer[offset++];
-            frame->data[i] = hexCharToByte(loHex) + (hexCharToByte(hiHex) << 4);
+            if (!hex_getByte(&buffer[offset], &frame->data[i])) {
+                canhacker_writePgmDebugStream(PSTR("Invalid data in transmit command\n"));
+                canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+                canhacker_writeDebugStream('\n');
+                return ERROR_INVALID_COMMAND;
+            }
+            offset += 2;
         }
     }
     return ERROR_OK;
 }
 
-static enum ERROR canhacker_createTransmit(const struct can_frame *frame, char *buffer, int length) {
+/*
+ * filter, one hex digit, follows the timestamp unless it is BINFRAME_NO_FILTER.
+ */
+static enum ERROR canhacker_createTransmit(const struct can_frame *frame, uint32_t timestamp, uint8_t filter,
+                                          char *buffer, int length) {
     int offset;
     int len = frame->can_dlc;
 
@@ -533,30 +1066,38 @@ static enum ERROR canhacker_createTransmit(const struct can_frame *frame, char *
         return ERROR_ERROR_FRAME_NOT_SUPPORTED;
     } else if (frame->can_id & CAN_EFF_FLAG) {
         buffer[0] = isRTR ? 'R' : 'T';
-        put_eff_id(buffer + 1, frame->can_id & CAN_EFF_MASK);
+        hex_putId(buffer + 1, frame->can_id & CAN_EFF_MASK, true);
         offset = 9;
     } else {
         buffer[0] = isRTR ? 'r' : 't';
-        put_sff_id(buffer + 1, frame->can_id & CAN_SFF_MASK);
+        hex_putId(buffer + 1, frame->can_id & CAN_SFF_MASK, false);
         offset = 4;
     }
 
-    buffer[offset++] = hex_asc_upper_lo(frame->can_dlc);
+    buffer[offset++] = hex_digit(frame->can_dlc);
 
     if (!isRTR) {
         int i;
         for (i = 0; i < len; i++) {
-            put_hex_byte(buffer + offset, frame->data[i]);
+            hex_putByte(buffer + offset, frame->data[i]);
             offset += 2;
         }
     }
 
-    if (timestampEnabled) {
-        uint16_t ts = canhacker_getTimestamp();
-        put_hex_byte(buffer + offset, ts >> 8);
+    if (timestampMode == TIMESTAMP_MILLIS) {
+        uint16_t ms = (timestamp / 1000) % TIMESTAMP_LIMIT;
+        hex_putByte(buffer + offset, ms >> 8);
         offset += 2;
-        put_hex_byte(buffer + offset, ts);
+        hex_putByte(buffer + offset, ms);
         offset += 2;
+    } else if (timestampMode == TIMESTAMP_MICROS) {
+        for (int8_t shift = 24; shift >= 0; shift -= 8) {
+            hex_putByte(buffer + offset, timestamp >> shift);
+            offset += 2;
+        }
+    }
+    if (filter != BINFRAME_NO_FILTER) {
+        buffer[offset++] = hex_digit(filter);
     }
 
     buffer[offset++] = CR;
@@ -583,9 +1124,14 @@ static enum ERROR canhacker_receiveTransmitCommand(const char *buffer, int lengt
     struct can_frame frame;
     enum ERROR error = canhacker_parseTransmit(buffer, length, &frame);
     if (error != ERROR_OK) {
+        canhacker_writeStream(BEL);
         return error;
     }
     error = canhacker_writeCan(&frame);
+    if (error == ERROR_BUFFER_OVERFLOW) {
+        // queue full, the host sends the frame again after the next CR or F poll
+        canhacker_writeStream(BEL);
+    }
     if (error != ERROR_OK) {
         return error;
     }
@@ -602,14 +1148,17 @@ enum ERROR canhacker_receiveTimestampCommand(const char *buffer, const int lengt
     }
     switch (buffer[1]) {
         case '0':
-            timestampEnabled = false;
+            timestampMode = TIMESTAMP_OFF;
             return canhacker_writeStream(CR);
         case '1':
-            timestampEnabled = true;
+            timestampMode = TIMESTAMP_MILLIS;
+            return canhacker_writeStream(CR);
+        case '2':
+            timestampMode = TIMESTAMP_MICROS;
             return canhacker_writeStream(CR);
         default:
             canhacker_writeStream(BEL);
-            canhacker_writePgmDebugStream(PSTR("Timestamp cammand must have value 0 or 1\n"));
+            canhacker_writePgmDebugStream(PSTR("Timestamp cammand must have value 0, 1 or 2\n"));
             canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
             canhacker_writeDebugStream('\n');
             return ERROR_INVALID_COMMAND;
@@ -617,6 +1166,207 @@ enum ERROR canhacker_receiveTimestampCommand(const char *buffer, const int lengt
     return ERROR_OK;
 }
 
+/*
+ * The acknowledge goes out in the protocol the command arrived in,
+ * everything after it in the newly selected one.
+ */
+enum ERROR canhacker_receiveBinaryModeCommand(const char *buffer, const int length) {
+    if (length != 2 || buffer[1] < '0' || buffer[1] > '2') {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Binary mode command must be B0, B1 or B2\n"));
+        canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+        canhacker_writeDebugStream('\n');
+        return ERROR_INVALID_COMMAND;
+    }
+    enum ERROR error = canhacker_writeStream(CR);
+    binaryMode = (buffer[1] != '0');
+    batchMode = (buffer[1] == '2');
+    return error;
+}
+
+/*
+ * H1 appends the MCP2515 filter, RXF0..RXF5, that accepted a frame to
+ * every received frame: one hex digit after the timestamp in ASCII, a
+ * byte after the data in binary. Hosts can tell streams apart by it
+ * without looking at the ids. F stands for unknown.
+ */
+enum ERROR canhacker_receiveFilterHitCommand(const char *buffer, const int length) {
+    if (length != 2 || (buffer[1] != '0' && buffer[1] != '1')) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Filter hit command must be H0 or H1\n"));
+        return ERROR_INVALID_COMMAND;
+    }
+    enum ERROR error = canhacker_writeStream(CR);
+    filterReport = (buffer[1] == '1');
+    return error;
+}
+
+/*
+ * K1, the default, plans the filters so that RXB1 only takes frames
+ * rolled over from RXB0 and every frame leaves in bus order. K0 lets the
+ * plan use RXF2..RXF5 as well, a finer first stage at the cost of that
+ * guarantee. The filters are planned again at once.
+ */
+enum ERROR canhacker_receiveReceiveOrderCommand(const char *buffer, const int length) {
+    if (length != 2 || (buffer[1] != '0' && buffer[1] != '1')) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Receive order command must be K0 or K1\n"));
+        return ERROR_INVALID_COMMAND;
+    }
+    filter_setOrdered(buffer[1] == '1');
+    enum ERROR error = canhacker_applyFilter();
+    if (error != ERROR_OK) {
+        return error;
+    }
+    return canhacker_writeStream(CR);
+}
+
+/*
+ * The acknowledge is sent at the old rate; the handler drains the TX
+ * ring before it reprograms the USART.
+ */
+enum ERROR canhacker_receiveSetUartBaudCommand(const char *buffer, const int length) {
+    if (isConnected) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Baud rate command cannot be called while connected\n"));
+        return ERROR_CONNECTED;
+    }
+    uint8_t index = (length == 2) ? (uint8_t) (buffer[1] - '0') : 0xFF;
+    if (index >= sizeof(uartBaudrates) / sizeof(uartBaudrates[0]) || baudrateHandler == NULL) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Baud rate command must be U0..U9\n"));
+        canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+        canhacker_writeDebugStream('\n');
+        return ERROR_INVALID_COMMAND;
+    }
+    enum ERROR error = canhacker_writeStream(CR);
+    if (baudrateHandler(pgm_read_dword(&uartBaudrates[index])) != 0) {
+        return ERROR_INVALID_COMMAND;
+    }
+    return error;
+}
+
+/*
+ * Y                    removes all cyclic frames
+ * Yn                   removes slot n
+ * YnppppooooccFRAME    sets slot n: period pppp and phase offset oooo in
+ *                      ms, index of the counter byte and of the checksum
+ *                      byte (F for none), then the frame as in t/T/r/R
+ */
+enum ERROR canhacker_receiveScheduleCommand(const char *buffer, const int length) {
+    if (length == 1) {
+        schedule_init();
+        if (isConnected && !listenOnly) {
+            schedule_start(millis());
+        }
+        return canhacker_writeStream(CR);
+    }
+    uint8_t slot = hex_nibble(buffer[1]);
+    if (length == 2 && slot < SCHEDULE_SIZE) {
+        schedule_remove(slot);
+        return canhacker_writeStream(CR);
+    }
+    struct can_frame frame;
+    if (length < 12 || canhacker_parseTransmit(&buffer[12], length - 12, &frame) != ERROR_OK) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Schedule command must be Y, Yn or YnppppooooccFRAME\n"));
+        canhacker_writeDebugStreamFromBufferWithSize((const uint8_t *) buffer, length);
+        canhacker_writeDebugStream('\n');
+        return ERROR_INVALID_COMMAND;
+    }
+    uint32_t period;
+    uint32_t offset;
+    uint8_t counterByte = hex_nibble(buffer[10]);
+    uint8_t checksumByte = hex_nibble(buffer[11]);
+    if (!hex_get(&buffer[2], 4, &period) || !hex_get(&buffer[6], 4, &offset)
+            || counterByte == HEX_INVALID || checksumByte == HEX_INVALID
+            || !schedule_set(slot, &frame, period, offset,
+                             counterByte == 0x0F ? SCHEDULE_NO_BYTE : counterByte,
+                             checksumByte == 0x0F ? SCHEDULE_NO_BYTE : checksumByte, millis())) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Invalid schedule slot, period or byte index\n"));
+        return ERROR_INVALID_COMMAND;
+    }
+    return canhacker_writeStream(CR);
+}
+
+/*
+ * f                    removes all rules, every frame is received
+ * fiii                 adds standard id iii
+ * fiiijjj              adds standard ids iii..jjj
+ * fiiiiiiii            adds extended id iiiiiiii
+ * fiiiiiiiijjjjjjjj    adds extended ids iiiiiiii..jjjjjjjj
+ * The MCP2515 filters are planned again after every change.
+ */
+enum ERROR canhacker_receiveFilterCommand(const char *buffer, const int length) {
+    if (length == 1) {
+        filter_clear();
+    } else {
+        uint8_t digits = (length == 4 || length == 7) ? 3 : 8;
+        if (length != 1 + digits && length != 1 + 2 * digits) {
+            canhacker_writeStream(BEL);
+            canhacker_writePgmDebugStream(PSTR("Filter command must be f, fiii, fiiijjj, fiiiiiiii or fiiiiiiiijjjjjjjj\n"));
+            return ERROR_INVALID_COMMAND;
+        }
+        uint32_t first;
+        uint32_t last;
+        if (!hex_get(&buffer[1], digits, &first)
+                || !hex_get(&buffer[length == 1 + digits ? 1 : 1 + digits], digits, &last)) {
+            canhacker_writeStream(BEL);
+            canhacker_writePgmDebugStream(PSTR("Filter id must be hex\n"));
+            return ERROR_INVALID_COMMAND;
+        }
+        uint32_t flag = digits == 8 ? CAN_EFF_FLAG : 0;
+        if (!filter_addRange(flag | first, flag | last)) {
+            canhacker_writeStream(BEL);
+            canhacker_writePgmDebugStream(PSTR("Filter rules full or range invalid\n"));
+            return ERROR_BUFFER_OVERFLOW;
+        }
+    }
+
+    enum ERROR error = canhacker_applyFilter();
+    if (error != ERROR_OK) {
+        return error;
+    }
+    return canhacker_writeStream(CR);
+}
+
+/*
+ * Wrrdd writes SJA1000 register rr. MOD (AFM, single/dual filter) and
+ * ACR0..3/AMR0..3 are mapped onto the MCP2515 filters, the other
+ * registers have no counterpart and are ignored.
+ */
+enum ERROR canhacker_receiveWriteRegisterCommand(const char *buffer, const int length) {
+    if (length != 5) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Write register command must be Wrrdd\n"));
+        return ERROR_INVALID_COMMAND;
+    }
+    uint8_t reg;
+    uint8_t value;
+    if (!hex_getByte(&buffer[1], &reg) || !hex_getByte(&buffer[3], &value)) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Write register command must be hex\n"));
+        return ERROR_INVALID_COMMAND;
+    }
+    if (reg == SJA1000_MOD) {
+        singleFilter = (value & SJA1000_MOD_AFM) != 0;
+    } else if (reg >= SJA1000_ACR0 && reg < SJA1000_ACR0 + 4) {
+        uint8_t shift = 8 * (3 - (reg - SJA1000_ACR0));
+        acceptanceCode = (acceptanceCode & ~((uint32_t) 0xFF << shift)) | ((uint32_t) value << shift);
+    } else if (reg >= SJA1000_AMR0 && reg < SJA1000_AMR0 + 4) {
+        uint8_t shift = 8 * (3 - (reg - SJA1000_AMR0));
+        acceptanceMask = (acceptanceMask & ~((uint32_t) 0xFF << shift)) | ((uint32_t) value << shift);
+    } else {
+        return canhacker_writeStream(CR);
+    }
+    enum ERROR error = canhacker_applySja1000Filter();
+    if (error != ERROR_OK) {
+        return error;
+    }
+    return canhacker_writeStream(CR);
+}
+
 enum ERROR canhacker_receiveCloseCommand(const char *buffer, const int length) {
     canhacker_writePgmDebugStream(PSTR("receiveCloseCommand\n"));
 
@@ -635,7 +1385,7 @@ enum ERROR canhacker_receiveCloseCommand(const char *buffer, const int length) {
     if (error != ERROR_OK) {
         return error;
     }
-    canhacker_writeStream(CR);
+    return canhacker_writeStream(CR);
 }
 
 enum ERROR canhacker_receiveOpenCommand(const char *buffer, const int length) {
@@ -653,7 +1403,66 @@ enum ERROR canhacker_receiveOpenCommand(const char *buffer, const int length) {
     if (error != ERROR_OK) {
         return error;
     }
-    canhacker_writeStream(CR);
+    return canhacker_writeStream(CR);
+}
+
+/*
+ * Lawicel status flags, "Fxx". Besides the error state it tells a host
+ * streaming t/T commands whether the transmit queue has room.
+ */
+enum ERROR canhacker_receiveReadStatusCommand(const char *buffer, const int length) {
+    if (length != 1) {
+        canhacker_writeStream(BEL);
+        return ERROR_INVALID_COMMAND;
+    }
+    if (!isConnected) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("Read status while not connected\n"));
+        return ERROR_NOT_CONNECTED;
+    }
+
+    uint8_t status = 0;
+    if (rxring_count() == RXRING_SIZE) {
+        status |= STATUS_RX_FULL;
+    }
+    if (txqueue_full()) {
+        status |= STATUS_TX_FULL;
+    }
+    // frames lost in the receive ring or in the MCP2515 itself
+    uint16_t overflows = rxring_overflows();
+    if (overflows != reportedOverflows) {
+        reportedOverflows = overflows;
+        status |= STATUS_DATA_OVERRUN;
+    }
+    uint8_t overruns;
+    bool txFailure;
+    ENTER_CRITICAL(R);
+    overruns = pendingOverruns;
+    pendingOverruns = 0;
+    txFailure = pendingTxFailure;
+    pendingTxFailure = false;
+    EXIT_CRITICAL(R);
+    if (overruns != 0) {
+        status |= STATUS_DATA_OVERRUN;
+    }
+    if (txFailure) {
+        status |= STATUS_TX_FAILED;
+    }
+    uint8_t eflg = getErrorFlags();
+    if (eflg & EFLG_EWARN) {
+        status |= STATUS_ERROR_WARNING;
+    }
+    if (eflg & (EFLG_TXEP | EFLG_RXEP)) {
+        status |= STATUS_ERROR_PASSIVE;
+    }
+    if (eflg & EFLG_TXBO) {
+        status |= STATUS_BUS_ERROR;
+    }
+
+    char out[5] = {COMMAND_READ_STATUS};
+    hex_putByte(out + 1, status);
+    out[3] = CR;
+    return canhacker_writeStreamFromBuffer(out);
 }
 
 enum ERROR canhacker_receiveListenOnlyCommand(const char *buffer, const int length) {
@@ -684,33 +1493,18 @@ enum ERROR canhacker_receiveSetAcrCommand(const char *buffer, const int length)
         canhacker_writeDebugStream('\n');
         return ERROR_INVALID_COMMAND;
     }
-    uint32_t id = 0;
-    for (int i=1; i<=8; i++) {
-        id <<= 4;
-        id += hexCharToByte(buffer[i]);
-    }
-
-    bool beenConnected = canhacker_isConnected();
-    enum ERROR error;
-
-    if (beenConnected) {
-        error = canhacker_disconnectCan();
-        if (error != ERROR_OK) {
-            return error;
-        }
+    uint32_t id;
+    if (!hex_get(&buffer[1], 8, &id)) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("ACR command must be hex\n"));
+        return ERROR_INVALID_COMMAND;
     }
 
-    error = setFilter(id);
+    acceptanceCode = id;
+    enum ERROR error = canhacker_applySja1000Filter();
     if (error != ERROR_OK) {
         return error;
     }
-
-    if (beenConnected) {
-        error = canhacker_connectCan();
-        if (error != ERROR_OK) {
-            return error;
-        }
-    }
     return canhacker_writeStream(CR);
 }
 
@@ -722,33 +1516,18 @@ enum ERROR canhacker_receiveSetAmrCommand(const char *buffer, const int length)
         canhacker_writeDebugStream('\n');
         return ERROR_INVALID_COMMAND;
     }
-    uint32_t id = 0;
-    for (int i=1; i<=8; i++) {
-        id <<= 4;
-        id += hexCharToByte(buffer[i]);
-    }
-
-    bool beenConnected = canhacker_isConnected();
-    enum ERROR error;
-
-    if (beenConnected) {
-        error = canhacker_disconnectCan();
-        if (error != ERROR_OK) {
-            return error;
-        }
+    uint32_t id;
+    if (!hex_get(&buffer[1], 8, &id)) {
+        canhacker_writeStream(BEL);
+        canhacker_writePgmDebugStream(PSTR("AMR command must be hex\n"));
+        return ERROR_INVALID_COMMAND;
     }
 
-    error = canhacker_setFilterMask(id);
+    acceptanceMask = id;
+    enum ERROR error = canhacker_applySja1000Filter();
     if (error != ERROR_OK) {
         return error;
     }
-
-    if (beenConnected) {
-        error = canhacker_connectCan();
-        if (error != ERROR_OK) {
-            return error;
-        }
-    }
     return canhacker_writeStream(CR);
 }
 
@@ -771,3 +1550,17 @@ enum ERROR disableLoopback(void) {
     loopback = false;
     return ERROR_OK;
 }
+
+#ifdef CANHACKER_BENCH
+/*
+ * Entry points for bench/bench_main.c, which times the static formatting
+ * and parsing functions on their own.
+ */
+enum ERROR canhacker_benchCreateTransmit(const struct can_frame *frame, char *buffer, int length) {
+    return canhacker_createTransmit(frame, 0, BINFRAME_NO_FILTER, buffer, length);
+}
+
+enum ERROR canhacker_benchParseTransmit(const char *buffer, int length, struct can_frame *frame) {
+    return canhacker_parseTransmit(buffer, length, frame);
+}
+#endif
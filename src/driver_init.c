@@ -106,7 +106,8 @@ void SPI_0_initialization(void)
 	    // <true"> High
 	    false);
 
-	SPI_0_init();
+	/* The MCP2515 driver uses polled transfers at fosc/2 */
+	SPI_0_init_polled();
 }
 
 void TIMER_0_initialization(void)
@@ -35,19 +35,62 @@
 
 #include <driver_init.h>
 #include <compiler.h>
+#include <canhacker.h>
+#include <millis.h>
+#include <schedule.h>
+#include <txqueue.h>
 
 volatile unsigned long timer1_millis;
+volatile uint32_t timer1_timestamp_millis;
 
 ISR(PCINT1_vect)
 {
-
-	/* Insert your pin change 1 interrupt handling code here */
+	/* Drain the MCP2515 while its INT line is asserted. The pin change
+	 * interrupt is masked so the USART interrupts can run meanwhile; it
+	 * stays masked while a receive buffer read runs on the SPI interrupt,
+	 * which restores it when it has finished the drain. */
+	PCICR &= ~(1 << PCIE1);
+	sei();
+	bool done = serviceInterrupt();
+	cli();
+	if (done) {
+		PCICR |= (1 << PCIE1);
+	}
 }
 
 
 ISR(TIMER1_COMPA_vect)
 {
+    static uint8_t period;
+
     timer1_millis++;
-    /* Insert your TIMER_0 compare channel A interrupt handling code here */
+    if (++timer1_timestamp_millis == TIMESTAMP_WRAP_MILLIS) {
+        timer1_timestamp_millis = 0;
+    }
+    /* OCR1A is not buffered in CTC mode, the new TOP applies to this period */
+    if (++period == TIMER_0_LONG_PERIOD) {
+        period = 0;
+        OCR1A = TIMER_0_TOP + 1;
+    } else {
+        OCR1A = TIMER_0_TOP;
+    }
+
+    /* Cyclic frames. The compare interrupt is masked and the others run
+     * meanwhile, like in ISR(PCINT1_vect); this ends well within the
+     * period, so no tick is lost. Due frames are loaded at once unless the
+     * tick interrupted the main loop or ISR(PCINT1_vect) while it held the
+     * MCP2515: then that context loads them when it is done, or the next
+     * tick does. */
+    TIMSK1 &= ~(1 << OCIE1A);
+    sei();
+    if (schedule_tick(timer1_millis)) {
+        uint8_t held = holdInterrupt();
+        if (held) {
+            txqueue_service();
+        }
+        releaseInterrupt(held);
+    }
+    cli();
+    TIMSK1 |= (1 << OCIE1A);
 }
 
@@ -45,9 +45,10 @@ int8_t EXTERNAL_IRQ_0_init()
 	        (1 << PCIE1) | // Enable pin change interrupt 1
 	        (1 << PCIE1);  // Enable pin change interrupt 1
 
-	PCMSK1 = (1 << PCINT8) | // Pin change enable mask 8
-	         (1 << PCINT9) | // Pin change enable mask 9
-	         (1 << PCINT10); // Pin change enable mask 10
+	/* INT (PCINT10) also falls for a full receive buffer. RX1BF (PCINT8)
+	 * and RX0BF (PCINT9) are read as levels by processInterrupt(), their
+	 * edges would only re-enter ISR(PCINT1_vect) with INT already high. */
+	PCMSK1 = (1 << PCINT10); // Pin change enable mask 10
 
 	return 0;
 }
@@ -0,0 +1,422 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "filter.h"
+#include <string.h>
+
+#define FILTER_STD_SHIFT 18
+#define FILTER_STD_BITS 11
+#define FILTER_EXT_BITS 29
+// RXF0/RXF1 under RXM0, RXF2..RXF5 under RXM1
+#define FILTER_GROUP0_FILTERS 2
+#define FILTER_GROUP1_FILTERS 4
+
+struct filter_cluster {
+    uint32_t id;    // register layout
+    uint32_t agree; // bits every member has in common and cares about
+    bool ext;
+    uint8_t members;
+};
+
+static struct filter_rule filter_rules[FILTER_RULES];
+static uint8_t filter_rulesCount;
+static bool filter_exact = true;
+// RXB1 only takes frames rolled over from RXB0, see filter_setOrdered()
+static bool filter_ordered = true;
+
+// second stage, rebuilt by filter_apply(); it keeps its own copy of the
+// masked extended rules, so editing the rules leaves it consistent
+static uint8_t filter_stdBitmap[(CAN_SFF_MASK + 1) / 8];
+static uint32_t filter_extIds[FILTER_EXT_IDS];
+static uint8_t filter_extIdsCount;
+static struct filter_rule filter_extRules[FILTER_RULES];
+static uint8_t filter_extRulesCount;
+
+static uint32_t filter_cost(uint32_t mask, bool ext);
+static uint32_t filter_split(const struct filter_cluster *clusters, uint8_t count, uint8_t group1Filters,
+                             uint8_t *group0);
+static void filter_build(void);
+
+void filter_clear(void)
+{
+    filter_rulesCount = 0;
+    filter_exact = true;
+}
+
+/*
+ * Returns false when the rule table is full. Bits of id outside mask are
+ * ignored.
+ */
+bool filter_add(const uint32_t id, const uint32_t mask)
+{
+    if (filter_rulesCount == FILTER_RULES) {
+        return false;
+    }
+    uint32_t idMask = (id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK;
+    filter_rules[filter_rulesCount].id = (id & CAN_EFF_FLAG) | (id & mask & idMask);
+    filter_rules[filter_rulesCount].mask = mask & idMask;
+    filter_rulesCount++;
+    return true;
+}
+
+/*
+ * Splits first..last into aligned power of two blocks, one rule each.
+ * Returns false, leaving the table unchanged, for ids that do not fit
+ * 11 or 29 bits, a reversed range or blocks that do not fit.
+ */
+bool filter_addRange(const uint32_t first, const uint32_t last)
+{
+    uint32_t flag = first & CAN_EFF_FLAG;
+    uint32_t idMask = flag ? CAN_EFF_MASK : CAN_SFF_MASK;
+    uint32_t from = first & ~CAN_EFF_FLAG;
+    uint32_t to = last & ~CAN_EFF_FLAG;
+    uint8_t saved = filter_rulesCount;
+    if ((last & CAN_EFF_FLAG) != flag || (from & ~idMask) != 0 || (to & ~idMask) != 0 || to < from) {
+        return false;
+    }
+    for (;;) {
+        uint32_t size = 1;
+        while ((from & ((size << 1) - 1)) == 0 && from + (size << 1) - 1 <= to && (size << 1) <= idMask) {
+            size <<= 1;
+        }
+        if (!filter_add(flag | from, idMask & ~(size - 1))) {
+            filter_rulesCount = saved;
+            return false;
+        }
+        if (from + size - 1 >= to) {
+            return true;
+        }
+        from += size;
+    }
+}
+
+/*
+ * Replaces the rules with the identifiers an SJA1000 (PeliCAN) acceptance
+ * filter passes. acr and amr are ACR0..ACR3 and AMR0..AMR3, ACR0 in the
+ * top byte; an AMR bit set means "don't care".
+ *
+ * Single filter: ACR0, ACR1[7:5] hold a standard id, ACR0..ACR3[7:3] an
+ *   extended one, both apply at the same time.
+ * Dual filter: ACR0, ACR1[7:5] and ACR2, ACR3[7:5] are two standard ids,
+ *   ACR0, ACR1 and ACR2, ACR3 the top 16 bits of two extended ids.
+ *
+ * The RTR and data byte bits of the SJA1000 filter are not taken over,
+ * such frames are accepted whatever those bits ask for.
+ */
+void filter_setSja1000(const uint32_t acr, const uint32_t amr, const bool singleFilter)
+{
+    uint32_t care = ~amr;
+
+    filter_clear();
+    if (singleFilter) {
+        filter_add(acr >> 21, care >> 21);
+        filter_add(CAN_EFF_FLAG | (acr >> 3), care >> 3);
+        return;
+    }
+    for (uint8_t shift = 0; shift <= 16; shift += 16) {
+        uint16_t code = (uint16_t) (acr >> (16 - shift));
+        uint16_t codeCare = (uint16_t) (care >> (16 - shift));
+        filter_add(code >> 5, codeCare >> 5);
+        filter_add(CAN_EFF_FLAG | ((uint32_t) code << 13), (uint32_t) codeCare << 13);
+    }
+}
+
+uint8_t filter_count(void)
+{
+    return filter_rulesCount;
+}
+
+/*
+ * A frame that goes straight into RXB1 through RXF2..RXF5 does not wait
+ * for RXB0, so when both buffers fill before the receive interrupt gets
+ * to them the MCP2515 has no record of which frame came first. Ordered
+ * plans use RXF0/RXF1 under RXM0 alone and let RXB1 take only what rolls
+ * over from a full RXB0, which keeps bus order; the price is a coarser
+ * first stage and more work for filter_accepts(). Takes effect with the
+ * next filter_apply().
+ */
+void filter_setOrdered(const bool ordered)
+{
+    filter_ordered = ordered;
+}
+
+/*
+ * Agglomerative clustering: rules start as clusters of their own and the
+ * pair whose merge adds the fewest accepted ids is merged until six are
+ * left. From six clusters down to one every split into two under RXM0
+ * and four under RXM1 is tried, and the cheapest wins. The cost of a
+ * filter is the number of ids it accepts, and a mask is shared by all
+ * filters of its group, so the split matters as much as the merges.
+ * Ordered plans put at most two clusters under RXM0 and give RXM1 and
+ * RXF2..RXF5 copies of RXM0 and RXF0/RXF1: a frame they match matches
+ * RXB0 first, so RXB1 only ever receives rollovers.
+ */
+void filter_plan(struct filter_plan *plan)
+{
+    struct filter_cluster clusters[FILTER_RULES];
+    struct filter_cluster best[FILTER_FILTERS];
+    uint8_t count = filter_rulesCount;
+    uint8_t bestCount = 0;
+    uint8_t bestGroup0 = 0;
+    uint32_t bestCost = UINT32_MAX;
+
+    if (count == 0) {
+        /* EXIDE still selects the frame format under an empty mask, so
+         * every group needs a standard and an extended filter, as after
+         * reset() */
+        for (uint8_t i = 0; i < FILTER_MASKS; i++) {
+            plan->mask[i] = 0;
+        }
+        for (uint8_t i = 0; i < FILTER_FILTERS; i++) {
+            plan->filter[i] = 0;
+            plan->ext[i] = (i & 1) != 0;
+        }
+        plan->exact = true;
+        return;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        const struct filter_rule *rule = &filter_rules[i];
+        bool ext = (rule->id & CAN_EFF_FLAG) != 0;
+        uint8_t shift = ext ? 0 : FILTER_STD_SHIFT;
+        clusters[i].id = (rule->id & CAN_EFF_MASK) << shift;
+        clusters[i].agree = rule->mask << shift;
+        clusters[i].ext = ext;
+        clusters[i].members = 1;
+    }
+
+    uint8_t group1Filters = filter_ordered ? 0 : FILTER_GROUP1_FILTERS;
+    for (;;) {
+        if (count <= FILTER_GROUP0_FILTERS + group1Filters) {
+            uint8_t group0 = 0;
+            uint32_t cost = filter_split(clusters, count, group1Filters, &group0);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestCount = count;
+                bestGroup0 = group0;
+                for (uint8_t i = 0; i < count; i++) {
+                    best[i] = clusters[i];
+                }
+            }
+        }
+        uint8_t a = 0;
+        uint8_t b = 0;
+        uint32_t added = UINT32_MAX;
+        for (uint8_t i = 0; i < count; i++) {
+            for (uint8_t j = i + 1; j < count; j++) {
+                if (clusters[i].ext != clusters[j].ext) {
+                    continue;
+                }
+                uint32_t agree = clusters[i].agree & clusters[j].agree & ~(clusters[i].id ^ clusters[j].id);
+                uint32_t merged = filter_cost(agree, clusters[i].ext);
+                uint32_t separate = filter_cost(clusters[i].agree, clusters[i].ext)
+                                    + filter_cost(clusters[j].agree, clusters[j].ext);
+                uint32_t cost = merged > separate ? merged - separate : 0;
+                if (cost < added) {
+                    added = cost;
+                    a = i;
+                    b = j;
+                }
+            }
+        }
+        if (added == UINT32_MAX) {
+            break;
+        }
+        clusters[a].agree &= clusters[b].agree & ~(clusters[a].id ^ clusters[b].id);
+        clusters[a].members += clusters[b].members;
+        clusters[b] = clusters[--count];
+    }
+
+    /* group 0 gets the clusters flagged in bestGroup0, group 1 the rest.
+     * Unused filters repeat the first one of their group, and an empty
+     * group matches a single wanted id */
+    uint32_t mask[FILTER_MASKS] = {CAN_EFF_MASK, CAN_EFF_MASK};
+    for (uint8_t i = 0; i < bestCount; i++) {
+        mask[(bestGroup0 >> i) & 1 ? 0 : 1] &= best[i].agree;
+    }
+    uint8_t slot[FILTER_MASKS] = {0, FILTER_GROUP0_FILTERS};
+    const uint8_t end[FILTER_MASKS] = {FILTER_GROUP0_FILTERS, FILTER_FILTERS};
+    plan->exact = true;
+    for (uint8_t i = 0; i < bestCount; i++) {
+        uint8_t group = (bestGroup0 >> i) & 1 ? 0 : 1;
+        plan->filter[slot[group]] = best[i].id & mask[group];
+        plan->ext[slot[group]] = best[i].ext;
+        slot[group]++;
+        if (best[i].members != 1 || (mask[group] & best[i].agree) != best[i].agree) {
+            plan->exact = false;
+        }
+    }
+    for (uint8_t group = 0; group < FILTER_MASKS; group++) {
+        uint8_t first = group == 0 ? 0 : FILTER_GROUP0_FILTERS;
+        if (group == 1 && filter_ordered) {
+            for (uint8_t i = first; i < FILTER_FILTERS; i++) {
+                plan->filter[i] = plan->filter[i % FILTER_GROUP0_FILTERS];
+                plan->ext[i] = plan->ext[i % FILTER_GROUP0_FILTERS];
+            }
+            plan->mask[group] = plan->mask[0];
+            continue;
+        }
+        if (slot[group] == first) {
+            mask[group] = best[0].ext ? CAN_EFF_MASK : (uint32_t) CAN_SFF_MASK << FILTER_STD_SHIFT;
+            plan->filter[first] = best[0].id;
+            plan->ext[first] = best[0].ext;
+            slot[group]++;
+        }
+        for (uint8_t i = slot[group]; i < end[group]; i++) {
+            plan->filter[i] = plan->filter[first];
+            plan->ext[i] = plan->ext[first];
+        }
+        plan->mask[group] = mask[group];
+    }
+}
+
+/*
+ * Writes the plan into the MCP2515, which has to be in configuration
+ * mode, and arms the second stage when the plan is not exact. The second
+ * stage is swapped with the receive interrupt held: setFilters() leaves
+ * the MCP2515 in configuration mode, so no frame arrives meanwhile, but
+ * the interrupt may still be reading the ones the old plan let through.
+ */
+enum MCP2515_ERROR filter_apply(void)
+{
+    struct filter_plan plan;
+    uint32_t filters[FILTER_FILTERS];
+    uint8_t extFilters = 0;
+
+    filter_plan(&plan);
+    for (uint8_t i = 0; i < FILTER_FILTERS; i++) {
+        filters[i] = plan.ext[i] ? plan.filter[i] : plan.filter[i] >> FILTER_STD_SHIFT;
+        if (plan.ext[i]) {
+            extFilters |= 1 << i;
+        }
+    }
+    enum MCP2515_ERROR result = setFilters(plan.mask, filters, extFilters);
+    if (result != MCP2515_ERROR_OK) {
+        return result;
+    }
+    uint8_t held = holdInterrupt();
+    if (!plan.exact) {
+        filter_build();
+    }
+    filter_exact = plan.exact;
+    releaseInterrupt(held);
+    return MCP2515_ERROR_OK;
+}
+
+/*
+ * Second stage, called from the receive interrupt for every frame the
+ * MCP2515 let through, so it has to be cheap: one bit test for standard
+ * ids, a binary search and the few masked rules for extended ones.
+ */
+bool filter_accepts(const struct can_frame *frame)
+{
+    if (filter_exact) {
+        return true;
+    }
+    if (!(frame->can_id & CAN_EFF_FLAG)) {
+        uint16_t id = frame->can_id & CAN_SFF_MASK;
+        return (filter_stdBitmap[id >> 3] & (1 << (id & 7))) != 0;
+    }
+    uint32_t id = frame->can_id & CAN_EFF_MASK;
+    uint8_t low = 0;
+    uint8_t high = filter_extIdsCount;
+    while (low < high) {
+        uint8_t middle = (low + high) / 2;
+        if (filter_extIds[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < filter_extIdsCount && filter_extIds[low] == id) {
+        return true;
+    }
+    for (uint8_t i = 0; i < filter_extRulesCount; i++) {
+        const struct filter_rule *rule = &filter_extRules[i];
+        if (((id ^ rule->id) & rule->mask) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Standard rules are expanded into the bitmap. Extended rules that name a
+ * single id go into the sorted table while it has room; the others are
+ * copied into the masked rule table.
+ */
+static void filter_build(void)
+{
+    memset(filter_stdBitmap, 0, sizeof(filter_stdBitmap));
+    filter_extIdsCount = 0;
+    filter_extRulesCount = 0;
+    for (uint8_t i = 0; i < filter_rulesCount; i++) {
+        const struct filter_rule *rule = &filter_rules[i];
+        if (!(rule->id & CAN_EFF_FLAG)) {
+            /* walks the ids that agree with the rule on the masked bits */
+            uint16_t free = ~rule->mask & CAN_SFF_MASK;
+            uint16_t id = 0;
+            do {
+                uint16_t match = (rule->id & CAN_SFF_MASK) | id;
+                filter_stdBitmap[match >> 3] |= 1 << (match & 7);
+                id = (id - free) & free;
+            } while (id != 0);
+        } else if (rule->mask == CAN_EFF_MASK && filter_extIdsCount < FILTER_EXT_IDS) {
+            uint32_t id = rule->id & CAN_EFF_MASK;
+            uint8_t j = filter_extIdsCount++;
+            for (; j > 0 && filter_extIds[j - 1] > id; j--) {
+                filter_extIds[j] = filter_extIds[j - 1];
+            }
+            filter_extIds[j] = id;
+        } else {
+            filter_extRules[filter_extRulesCount++] = *rule;
+        }
+    }
+}
+
+/*
+ * Ids a filter accepts under mask, saturating at 2^29.
+ */
+static uint32_t filter_cost(const uint32_t mask, const bool ext)
+{
+    uint32_t bits = ext ? mask & CAN_EFF_MASK : (mask >> FILTER_STD_SHIFT) & CAN_SFF_MASK;
+    uint8_t free = ext ? FILTER_EXT_BITS : FILTER_STD_BITS;
+    while (bits != 0) {
+        bits &= bits - 1;
+        free--;
+    }
+    return (uint32_t) 1 << free;
+}
+
+/*
+ * Cheapest split of the clusters into at most two under RXM0 and at most
+ * group1Filters under RXM1. Bit i of group0 set puts cluster i under RXM0.
+ */
+static uint32_t filter_split(const struct filter_cluster *clusters, const uint8_t count, const uint8_t group1Filters,
+                             uint8_t *group0)
+{
+    uint32_t bestCost = UINT32_MAX;
+    for (uint8_t set = 0; set < (1 << count); set++) {
+        uint8_t size = 0;
+        uint32_t mask[FILTER_MASKS] = {CAN_EFF_MASK, CAN_EFF_MASK};
+        for (uint8_t i = 0; i < count; i++) {
+            uint8_t group = (set >> i) & 1 ? 0 : 1;
+            size += group == 0;
+            mask[group] &= clusters[i].agree;
+        }
+        if (size > FILTER_GROUP0_FILTERS || count - size > group1Filters) {
+            continue;
+        }
+        uint32_t cost = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            uint32_t add = filter_cost(mask[(set >> i) & 1 ? 0 : 1], clusters[i].ext);
+            cost = cost + add < cost ? UINT32_MAX : cost + add;
+        }
+        if (cost < bestCost) {
+            bestCost = cost;
+            *group0 = set;
+        }
+    }
+    return bestCost;
+}
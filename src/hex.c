@@ -0,0 +1,58 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "hex.h"
+
+#define HEX_ROW(hi) \
+    {hi, '0'}, {hi, '1'}, {hi, '2'}, {hi, '3'}, {hi, '4'}, {hi, '5'}, {hi, '6'}, {hi, '7'}, \
+    {hi, '8'}, {hi, '9'}, {hi, 'A'}, {hi, 'B'}, {hi, 'C'}, {hi, 'D'}, {hi, 'E'}, {hi, 'F'}
+
+const char hex_pairs[256][2] PROGMEM = {
+    HEX_ROW('0'), HEX_ROW('1'), HEX_ROW('2'), HEX_ROW('3'),
+    HEX_ROW('4'), HEX_ROW('5'), HEX_ROW('6'), HEX_ROW('7'),
+    HEX_ROW('8'), HEX_ROW('9'), HEX_ROW('A'), HEX_ROW('B'),
+    HEX_ROW('C'), HEX_ROW('D'), HEX_ROW('E'), HEX_ROW('F')
+};
+
+// stored off by one so that the unlisted characters, 0, come out as HEX_INVALID
+const uint8_t hex_values[256] PROGMEM = {
+    ['0'] = 0x01, ['1'] = 0x02, ['2'] = 0x03, ['3'] = 0x04, ['4'] = 0x05,
+    ['5'] = 0x06, ['6'] = 0x07, ['7'] = 0x08, ['8'] = 0x09, ['9'] = 0x0A,
+    ['A'] = 0x0B, ['B'] = 0x0C, ['C'] = 0x0D, ['D'] = 0x0E, ['E'] = 0x0F, ['F'] = 0x10,
+    ['a'] = 0x0B, ['b'] = 0x0C, ['c'] = 0x0D, ['d'] = 0x0E, ['e'] = 0x0F, ['f'] = 0x10
+};
+
+/*
+ * Writes a 3 (standard) or 8 (extended) digit CAN identifier.
+ */
+void hex_putId(char *out, uint32_t id, bool extended) {
+    if (extended) {
+        hex_putByte(out, id >> 24);
+        hex_putByte(out + 2, id >> 16);
+        hex_putByte(out + 4, id >> 8);
+        hex_putByte(out + 6, id);
+    } else {
+        out[0] = hex_digit(id >> 8);
+        hex_putByte(out + 1, id);
+    }
+}
+
+/*
+ * Reads digits hex digits into *value. Returns false, and leaves *value
+ * alone, when one of them is no hex digit.
+ */
+bool hex_get(const char *in, uint8_t digits, uint32_t *value) {
+    uint32_t result = 0;
+    uint8_t invalid = 0;
+    while (digits--) {
+        uint8_t nibble = hex_nibble(*in++);
+        invalid |= nibble;
+        result = (result << 4) | (nibble & 0x0F);
+    }
+    if (invalid == HEX_INVALID) {
+        return false;
+    }
+    *value = result;
+    return true;
+}
@@ -2,19 +2,13 @@
 // Created by marcin on 27.07.2021.
 //
 #include "lib.h"
+#include "hex.h"
 #include <stdint.h>
 
 unsigned char hexCharToByte(char hex)
 {
-    unsigned char result = 0;
-    if (hex >= 0x30 && hex <= 0x39) {
-        result = hex - 0x30;
-    } else if (hex >= 0x41 && hex <= 0x46) {
-        result = hex - 0x41 + 0x0A;
-    } else if (hex >= 0x61 && hex <= 0x66) {
-        result = hex - 0x61 + 0x0A;
-    }
-    return result;
+    uint8_t result = hex_nibble(hex);
+    return result == HEX_INVALID ? 0 : result;
 }
 
 uint8_t ascii2byte (const uint8_t *val) {
@@ -1,11 +1,28 @@
 #include <atmel_start.h>
+#include <canhacker.h>
+
+static int usart_putchar(char c, FILE *stream)
+{
+	USART_0_write(c);
+	return 0;
+}
+
+static FILE usart_stream = FDEV_SETUP_STREAM(usart_putchar, NULL, _FDEV_SETUP_WRITE);
 
 int main(void)
 {
 	/* Initializes MCU, drivers and middleware */
 	atmel_start_init();
 
-	/* Replace with your application code */
+	CanHacker(&usart_stream, NULL);
+	setBaudrateHandler(USART_0_set_baudrate);
+	setBlockWriter(USART_0_write_block);
+	setBlockReader(USART_0_read_until);
+	sei();
+
+	/* Frames are captured by ISR(PCINT1_vect), the loop formats and ships them and takes host commands in between */
 	while (1) {
+		pollReceiveCan();
+		pollCommand();
 	}
 }
@@ -6,7 +6,10 @@
 #include <stdint.h>
 #include <util/delay.h>
 #include <string.h>
+#include <avr/pgmspace.h>
 #include <driver_init.h>
+#include <atomic.h>
+#include <millis.h>
 
 static const uint8_t CANCTRL_REQOP = 0xE0;
 // static const uint8_t CANCTRL_ABAT = 0x10;
@@ -26,8 +29,71 @@ enum /*class*/ CANCTRL_REQOP_MODE {
 static const uint8_t CANSTAT_OPMOD = 0xE0;
 // static const uint8_t CANSTAT_ICOD = 0x0E;
 
+static const uint8_t CNF2_BTLMODE = 0x80;
+static const uint8_t CNF2_SAM = 0x40;
 static const uint8_t CNF3_SOF = 0x80;
 
+#define BIT_TIMING_MIN_TQ 5
+#define BIT_TIMING_MAX_TQ 25
+#define BIT_TIMING_MAX_BRP 64
+
+#define BIT_TIMING(clock, speed) {MCP_##clock##_##speed##_CFG1, MCP_##clock##_##speed##_CFG2, MCP_##clock##_##speed##_CFG3}
+
+// a zero CNF2 marks a combination without a tested configuration
+static const struct bit_timing bitTimings[][CAN_1000KBPS + 1] PROGMEM = {
+    [MCP_20MHZ] = {
+        [CAN_33KBPS] = BIT_TIMING(20MHz, 33k3BPS),
+        [CAN_40KBPS] = BIT_TIMING(20MHz, 40kBPS),
+        [CAN_50KBPS] = BIT_TIMING(20MHz, 50kBPS),
+        [CAN_80KBPS] = BIT_TIMING(20MHz, 80kBPS),
+        [CAN_83K3BPS] = BIT_TIMING(20MHz, 83k3BPS),
+        [CAN_100KBPS] = BIT_TIMING(20MHz, 100kBPS),
+        [CAN_125KBPS] = BIT_TIMING(20MHz, 125kBPS),
+        [CAN_200KBPS] = BIT_TIMING(20MHz, 200kBPS),
+        [CAN_250KBPS] = BIT_TIMING(20MHz, 250kBPS),
+        [CAN_500KBPS] = BIT_TIMING(20MHz, 500kBPS),
+        [CAN_1000KBPS] = BIT_TIMING(20MHz, 1000kBPS)
+    },
+    [MCP_16MHZ] = {
+        [CAN_5KBPS] = BIT_TIMING(16MHz, 5kBPS),
+        [CAN_10KBPS] = BIT_TIMING(16MHz, 10kBPS),
+        [CAN_20KBPS] = BIT_TIMING(16MHz, 20kBPS),
+        [CAN_33KBPS] = BIT_TIMING(16MHz, 33k3BPS),
+        [CAN_40KBPS] = BIT_TIMING(16MHz, 40kBPS),
+        [CAN_50KBPS] = BIT_TIMING(16MHz, 50kBPS),
+        [CAN_80KBPS] = BIT_TIMING(16MHz, 80kBPS),
+        [CAN_83K3BPS] = BIT_TIMING(16MHz, 83k3BPS),
+        [CAN_100KBPS] = BIT_TIMING(16MHz, 100kBPS),
+        [CAN_125KBPS] = BIT_TIMING(16MHz, 125kBPS),
+        [CAN_200KBPS] = BIT_TIMING(16MHz, 200kBPS),
+        [CAN_250KBPS] = BIT_TIMING(16MHz, 250kBPS),
+        [CAN_500KBPS] = BIT_TIMING(16MHz, 500kBPS),
+        [CAN_1000KBPS] = BIT_TIMING(16MHz, 1000kBPS)
+    },
+    [MCP_8MHZ] = {
+        [CAN_5KBPS] = BIT_TIMING(8MHz, 5kBPS),
+        [CAN_10KBPS] = BIT_TIMING(8MHz, 10kBPS),
+        [CAN_20KBPS] = BIT_TIMING(8MHz, 20kBPS),
+        [CAN_31K25BPS] = BIT_TIMING(8MHz, 31k25BPS),
+        [CAN_33KBPS] = BIT_TIMING(8MHz, 33k3BPS),
+        [CAN_40KBPS] = BIT_TIMING(8MHz, 40kBPS),
+        [CAN_50KBPS] = BIT_TIMING(8MHz, 50kBPS),
+        [CAN_80KBPS] = BIT_TIMING(8MHz, 80kBPS),
+        [CAN_100KBPS] = BIT_TIMING(8MHz, 100kBPS),
+        [CAN_125KBPS] = BIT_TIMING(8MHz, 125kBPS),
+        [CAN_200KBPS] = BIT_TIMING(8MHz, 200kBPS),
+        [CAN_250KBPS] = BIT_TIMING(8MHz, 250kBPS),
+        [CAN_500KBPS] = BIT_TIMING(8MHz, 500kBPS),
+        [CAN_1000KBPS] = BIT_TIMING(8MHz, 1000kBPS)
+    }
+};
+
+static const uint32_t canClockFrequency[] PROGMEM = {
+    [MCP_20MHZ] = 20000000UL,
+    [MCP_16MHZ] = 16000000UL,
+    [MCP_8MHZ] = 8000000UL
+};
+
 static const uint8_t TXB_EXIDE_MASK = 0x08;
 static const uint8_t DLC_MASK = 0x0F;
 static const uint8_t RTR_MASK = 0x40;
@@ -36,12 +102,18 @@ static const uint8_t RTR_MASK = 0x40;
 // static const uint8_t RXBnCTRL_RXM_EXT = 0x40;
 static const uint8_t RXBnCTRL_RXM_STDEXT = 0x00;
 static const uint8_t RXBnCTRL_RXM_MASK = 0x60;
-static const uint8_t RXBnCTRL_RTR = 0x08;
+// static const uint8_t RXBnCTRL_RTR = 0x08;
+static const uint8_t RXBnSIDL_SRR = 0x10;
 static const uint8_t RXB0CTRL_BUKT = 0x04;
 static const uint8_t RXB0CTRL_FILHIT_MASK = 0x03;
 static const uint8_t RXB1CTRL_FILHIT_MASK = 0x07;
 static const uint8_t RXB0CTRL_FILHIT = 0x00;
 static const uint8_t RXB1CTRL_FILHIT = 0x01;
+static const uint8_t RXB0CTRL_FILHIT0 = 0x01;
+static const uint8_t BFPCTRL_B0BFM = 0x01;
+static const uint8_t BFPCTRL_B1BFM = 0x02;
+static const uint8_t BFPCTRL_B0BFE = 0x04;
+static const uint8_t BFPCTRL_B1BFE = 0x08;
 
 static const uint8_t MCP_SIDH = 0;
 static const uint8_t MCP_SIDL = 1;
@@ -52,7 +124,10 @@ static const uint8_t MCP_DATA = 5;
 
 enum /*class*/ STAT {
     STAT_RX0IF = (1 << 0),
-    STAT_RX1IF = (1 << 1)
+    STAT_RX1IF = (1 << 1),
+    STAT_TX0REQ = (1 << 2),
+    STAT_TX1REQ = (1 << 4),
+    STAT_TX2REQ = (1 << 6)
 };
 
 static const uint8_t STAT_RXIF_MASK = STAT_RX0IF | STAT_RX1IF;
@@ -103,6 +178,8 @@ enum /*class*/ REGISTER {
     MCP_RXF2SIDL = 0x09,
     MCP_RXF2EID8 = 0x0A,
     MCP_RXF2EID0 = 0x0B,
+    MCP_BFPCTRL = 0x0C,
+    MCP_TXRTSCTRL = 0x0D,
     MCP_CANSTAT = 0x0E,
     MCP_CANCTRL = 0x0F,
     MCP_RXF3SIDH = 0x10,
@@ -177,6 +254,9 @@ typedef struct {
     enum REGISTER CTRL;
     enum REGISTER SIDH;
     enum REGISTER DATA;
+    enum INSTRUCTION LOAD_TX;
+    enum INSTRUCTION RTS;
+    enum STAT STAT_TXREQ;
 } TXB;
 
 typedef struct {
@@ -184,9 +264,17 @@ typedef struct {
     enum REGISTER SIDH;
     enum REGISTER DATA;
     enum CANINTF CANINTF_RXnIF;
+    enum INSTRUCTION READ_RX;
 } RXB;
 
 uint8_t SPICS;
+static uint8_t spiPinChangeIrq;
+#ifdef MCP2515_RX_SPI_INTERRUPT
+// READ RX BUFFER instruction, RXBnSIDH..RXBnDLC and RXBnD0..RXBnD7, see startReadMessage()
+static uint8_t rxRead[1 + 5 + CAN_MAX_DLEN];
+static volatile bool rxReading;
+static void (*rxReadDone)(void);
+#endif
 
 static void startSPI(void);
 
@@ -196,8 +284,6 @@ static enum MCP2515_ERROR setMode(enum CANCTRL_REQOP_MODE mode);
 
 static uint8_t readRegister(enum REGISTER reg);
 
-static void readRegisters(enum REGISTER reg, uint8_t values[], uint8_t n);
-
 static void setRegister(enum REGISTER reg, uint8_t value);
 
 static void setRegisters(enum REGISTER reg, const uint8_t values[], uint8_t n);
@@ -206,15 +292,17 @@ static void modifyRegister(enum REGISTER reg, uint8_t mask, uint8_t data);
 
 static void prepareId(uint8_t *buffer, bool ext, uint32_t id);
 
+static void requestToSend(enum TXBn txbn);
+
 TXB TXBn_REGS[N_TXBUFFERS] = {
-        {MCP_TXB0CTRL, MCP_TXB0SIDH, MCP_TXB0DATA},
-        {MCP_TXB1CTRL, MCP_TXB1SIDH, MCP_TXB1DATA},
-        {MCP_TXB2CTRL, MCP_TXB2SIDH, MCP_TXB2DATA}
+        {MCP_TXB0CTRL, MCP_TXB0SIDH, MCP_TXB0DATA, INSTRUCTION_LOAD_TX0, INSTRUCTION_RTS_TX0, STAT_TX0REQ},
+        {MCP_TXB1CTRL, MCP_TXB1SIDH, MCP_TXB1DATA, INSTRUCTION_LOAD_TX1, INSTRUCTION_RTS_TX1, STAT_TX1REQ},
+        {MCP_TXB2CTRL, MCP_TXB2SIDH, MCP_TXB2DATA, INSTRUCTION_LOAD_TX2, INSTRUCTION_RTS_TX2, STAT_TX2REQ}
 };
 
 RXB RXBn_REGS[N_RXBUFFERS] = {
-        {MCP_RXB0CTRL, MCP_RXB0SIDH, MCP_RXB0DATA, CANINTF_RX0IF},
-        {MCP_RXB1CTRL, MCP_RXB1SIDH, MCP_RXB1DATA, CANINTF_RX1IF}
+        {MCP_RXB0CTRL, MCP_RXB0SIDH, MCP_RXB0DATA, CANINTF_RX0IF, INSTRUCTION_READ_RX0},
+        {MCP_RXB1CTRL, MCP_RXB1SIDH, MCP_RXB1DATA, CANINTF_RX1IF, INSTRUCTION_READ_RX1}
 };
 
 void MCP2515(){
@@ -222,87 +310,109 @@ void MCP2515(){
     endSPI();
 }
 
+/*
+ * The receive path talks to the MCP2515 from ISR(PCINT1_vect), so the pin
+ * change interrupt is held off for the whole chip-select window and
+ * restored afterwards. Inside the handler it is already masked and stays so.
+ */
 void startSPI() {
+    spiPinChangeIrq = holdInterrupt();
     SS_set_level(false);
 }
 
 void endSPI() {
     SS_set_level(true);
+    PCICR |= spiPinChangeIrq;
+}
+
+/*
+ * Same as startSPI()/endSPI() for a sequence of chip-select windows that
+ * must not be interleaved with ISR(PCINT1_vect). They nest: inside the
+ * handler, or inside another hold, nothing is changed. A receive buffer
+ * read the handler left running on the SPI interrupt is waited for.
+ */
+uint8_t holdInterrupt(void) {
+    uint8_t held;
+#ifdef MCP2515_RX_SPI_INTERRUPT
+    // a receive buffer read started by the handler still owns the bus
+    for (;;) {
+        ENTER_CRITICAL(H);
+        if (!rxReading) {
+            break;
+        }
+        EXIT_CRITICAL(H);
+    }
+#else
+    ENTER_CRITICAL(H);
+#endif
+    held = PCICR & (1 << PCIE1);
+    PCICR &= ~(1 << PCIE1);
+    EXIT_CRITICAL(H);
+    return held;
+}
+
+void releaseInterrupt(const uint8_t held) {
+    PCICR |= held;
 }
 
 enum MCP2515_ERROR reset(){
     startSPI();
-    SPI_0_exchange_byte(INSTRUCTION_RESET);
+    SPI_0_exchange_byte_polled(INSTRUCTION_RESET);
     endSPI();
     _delay_ms(10);
+    uint8_t ops[MCP_TRANSACTION_BYTES(8, 3 * 14 + 2 * 2 + 3)];
+    struct mcp_transaction transaction;
+    beginTransaction(&transaction, ops, sizeof ops);
     uint8_t zeros[14];
     memset(zeros, 0, sizeof(zeros));
-    setRegisters(MCP_TXB0CTRL, zeros, 14);
-    setRegisters(MCP_TXB1CTRL, zeros, 14);
-    setRegisters(MCP_TXB2CTRL, zeros, 14);
+    queueWrite(&transaction, MCP_TXB0CTRL, zeros, 14);
+    queueWrite(&transaction, MCP_TXB1CTRL, zeros, 14);
+    queueWrite(&transaction, MCP_TXB2CTRL, zeros, 14);
 
-    setRegister(MCP_RXB0CTRL, 0);
-    setRegister(MCP_RXB1CTRL, 0);
-    setRegister(MCP_CANINTE, CANINTF_RX0IF | CANINTF_RX1IF | CANINTF_ERRIF | CANINTF_MERRF);
     // receives all valid messages using either Standard or Extended Identifiers that
     // meet filter criteria. RXF0 is applied for RXB0, RXF1 is applied for RXB1
-    modifyRegister(MCP_RXB0CTRL,
-                   RXBnCTRL_RXM_MASK | RXB0CTRL_BUKT | RXB0CTRL_FILHIT_MASK,
-                   RXBnCTRL_RXM_STDEXT | RXB0CTRL_BUKT | RXB0CTRL_FILHIT);
-    modifyRegister(MCP_RXB1CTRL,
-                   RXBnCTRL_RXM_MASK | RXB1CTRL_FILHIT_MASK,
-                   RXBnCTRL_RXM_STDEXT | RXB1CTRL_FILHIT);
+    queueModify(&transaction, MCP_RXB0CTRL,
+                RXBnCTRL_RXM_MASK | RXB0CTRL_BUKT | RXB0CTRL_FILHIT_MASK,
+                RXBnCTRL_RXM_STDEXT | RXB0CTRL_BUKT | RXB0CTRL_FILHIT);
+    queueModify(&transaction, MCP_RXB1CTRL,
+                RXBnCTRL_RXM_MASK | RXB1CTRL_FILHIT_MASK,
+                RXBnCTRL_RXM_STDEXT | RXB1CTRL_FILHIT);
+    // RX0BF/RX1BF go low while RXB0/RXB1 hold a frame, processInterrupt()
+    // picks the buffer from the pins instead of reading CANINTF
+    const uint8_t bfpctrl = BFPCTRL_B0BFE | BFPCTRL_B1BFE | BFPCTRL_B0BFM | BFPCTRL_B1BFM;
+    queueWrite(&transaction, MCP_BFPCTRL, &bfpctrl, 1);
+#ifdef MCP2515_TXRTS_PINS
+    // TX0RTS..TX2RTS request transmission on a falling edge
+    const uint8_t txrtsctrl = 0x07;
+    queueWrite(&transaction, MCP_TXRTSCTRL, &txrtsctrl, 1);
+#endif
+    const uint8_t caninte = CANINTF_RX0IF | CANINTF_RX1IF | CANINTF_TX0IF | CANINTF_TX1IF | CANINTF_TX2IF
+                            | CANINTF_ERRIF | CANINTF_MERRF;
+    queueWrite(&transaction, MCP_CANINTE, &caninte, 1);
+    runTransaction(&transaction, NULL);
 
     // clear filters and masks
     // do not filter any standard frames for RXF0 used by RXB0
     // do not filter any extended frames for RXF1 used by RXB1
-    enum RXF filters[] = {RXF0, RXF1, RXF2, RXF3, RXF4, RXF5};
-    for (int i=0; i<6; i++) {
-        bool ext = (i == 1);
-        enum MCP2515_ERROR result = setFilter(filters[i], ext, 0);
-        if (result != MCP2515_ERROR_OK) {
-            return result;
-        }
-    }
-
-    enum MASK masks[] = {MASK0, MASK1};
-    for (int i=0; i<2; i++) {
-        enum MCP2515_ERROR result = setFilterMask(masks[i], true, 0);
-        if (result != MCP2515_ERROR_OK) {
-            return result;
-        }
-    }
-
-    return MCP2515_ERROR_OK;
+    const uint32_t masks[2] = {0, 0};
+    const uint32_t filters[6] = {0, 0, 0, 0, 0, 0};
+    return setFilters(masks, filters, 1 << RXF1);
 }
 
 uint8_t readRegister(const enum REGISTER reg){
     startSPI();
-    SPI_0_exchange_byte(INSTRUCTION_READ);
-    SPI_0_exchange_byte(reg);
-    uint8_t ret = SPI_0_exchange_byte(0x00);
+    SPI_0_exchange_byte_polled(INSTRUCTION_READ);
+    SPI_0_exchange_byte_polled(reg);
+    uint8_t ret = SPI_0_exchange_byte_polled(0x00);
     endSPI();
     return ret;
 }
 
-void readRegisters(const enum REGISTER reg, uint8_t values[], const uint8_t n)
-{
-    startSPI();
-    SPI_0_exchange_byte(INSTRUCTION_READ);
-    SPI_0_exchange_byte(reg);
-    // mcp2515 has auto-increment of address-pointer
-    for (uint8_t i=0; i<n; i++) {
-        values[i] = SPI_0_exchange_byte(0x00);
-    }
-    endSPI();
-}
-
 void setRegister(const enum REGISTER reg, const uint8_t value)
 {
     startSPI();
     uint8_t block[3] = {INSTRUCTION_WRITE, reg, value};
-    SPI_0_write_block(block, 3);
-    while (SPI_0_status_busy());
+    SPI_0_write_block_polled(block, 3);
     endSPI();
 }
 
@@ -310,10 +420,8 @@ void setRegisters(const enum REGISTER reg, const uint8_t values[], const uint8_t
 {
     startSPI();
     uint8_t block[2] = {INSTRUCTION_WRITE, reg};
-    SPI_0_write_block(block, 2);
-    while (SPI_0_status_busy());
-    SPI_0_write_block(&values, n);
-    while (SPI_0_status_busy());
+    SPI_0_write_block_polled(block, 2);
+    SPI_0_write_block_polled(values, n);
     endSPI();
 }
 
@@ -321,20 +429,132 @@ void modifyRegister(const enum REGISTER reg, const uint8_t mask, const uint8_t d
 {
     startSPI();
     uint8_t block[4] = {INSTRUCTION_BITMOD, reg, mask, data};
-    SPI_0_write_block(block, 4);
-    while (SPI_0_status_busy());
+    SPI_0_write_block_polled(block, 4);
     endSPI();
 }
 
+void beginTransaction(struct mcp_transaction *transaction, uint8_t ops[], const uint8_t size)
+{
+    transaction->ops = ops;
+    transaction->size = size;
+    transaction->length = 0;
+    transaction->last = 0;
+}
+
+/*
+ * Extends the last instruction when it is the same READ or WRITE and ends
+ * where this one starts, else opens a new one. Returns where the stored
+ * payload goes, NULL when the transaction is full.
+ */
+static uint8_t *queueInstruction(struct mcp_transaction *transaction, const enum INSTRUCTION instruction,
+                                 const uint8_t reg, const uint8_t count, const uint8_t stored)
+{
+    uint8_t *last = &transaction->ops[transaction->last];
+    if (transaction->length != 0 && instruction != INSTRUCTION_BITMOD
+        && last[0] == instruction && (uint8_t) (last[1] + last[2]) == reg) {
+        if (transaction->length + stored > transaction->size) {
+            return NULL;
+        }
+        last[2] += count;
+    } else {
+        if (transaction->length + 3 + stored > transaction->size) {
+            return NULL;
+        }
+        transaction->last = transaction->length;
+        last = &transaction->ops[transaction->length];
+        last[0] = instruction;
+        last[1] = reg;
+        last[2] = count;
+        transaction->length += 3;
+    }
+    uint8_t *payload = &transaction->ops[transaction->length];
+    transaction->length += stored;
+    return payload;
+}
+
+bool queueRead(struct mcp_transaction *transaction, const uint8_t reg, const uint8_t n)
+{
+    return queueInstruction(transaction, INSTRUCTION_READ, reg, n, 0) != NULL;
+}
+
+bool queueWrite(struct mcp_transaction *transaction, const uint8_t reg, const uint8_t values[], const uint8_t n)
+{
+    uint8_t *payload = queueInstruction(transaction, INSTRUCTION_WRITE, reg, n, n);
+    if (payload == NULL) {
+        return false;
+    }
+    memcpy(payload, values, n);
+    return true;
+}
+
+bool queueModify(struct mcp_transaction *transaction, const uint8_t reg, const uint8_t mask, const uint8_t data)
+{
+    uint8_t *payload = queueInstruction(transaction, INSTRUCTION_BITMOD, reg, 2, 2);
+    if (payload == NULL) {
+        return false;
+    }
+    payload[0] = mask;
+    payload[1] = data;
+    return true;
+}
+
+/*
+ * Runs the queued instructions in order; the bytes of the reads go one
+ * after the other into results.
+ */
+void runTransaction(const struct mcp_transaction *transaction, uint8_t results[])
+{
+    uint8_t held = holdInterrupt();
+    uint8_t offset = 0;
+    while (offset < transaction->length) {
+        const uint8_t *op = &transaction->ops[offset];
+        SS_set_level(false);
+        SPI_0_write_block_polled(op, 2);
+        if (op[0] == INSTRUCTION_READ) {
+            SPI_0_read_block_polled(results, op[2]);
+            results += op[2];
+            offset += 3;
+        } else {
+            SPI_0_write_block_polled(&op[3], op[2]);
+            offset += 3 + op[2];
+        }
+        SS_set_level(true);
+    }
+    releaseInterrupt(held);
+}
+
 uint8_t getStatus(void)
 {
     startSPI();
-    SPI_0_exchange_byte(INSTRUCTION_READ_STATUS);
-    uint8_t i = SPI_0_exchange_byte(0x00);
+    SPI_0_exchange_byte_polled(INSTRUCTION_READ_STATUS);
+    uint8_t i = SPI_0_exchange_byte_polled(0x00);
     endSPI();
     return i;
 }
 
+/*
+ * Full receive buffers, frame type and matching filter in one byte. With
+ * both buffers full the type and filter are those of RXB0.
+ */
+uint8_t getRxStatus(void)
+{
+    startSPI();
+    SPI_0_exchange_byte_polled(INSTRUCTION_RX_STATUS);
+    uint8_t i = SPI_0_exchange_byte_polled(0x00);
+    endSPI();
+    return i;
+}
+
+/*
+ * RXF0..RXF5 that accepted the frame in rxbn, from RXBnCTRL.FILHIT. Unlike
+ * RX STATUS it names the filter of RXB1 while RXB0 is full too.
+ */
+uint8_t getFilterHit(const enum RXBn rxbn)
+{
+    uint8_t ctrl = readRegister(RXBn_REGS[rxbn].CTRL);
+    return ctrl & (rxbn == RXB0 ? RXB0CTRL_FILHIT0 : RXB1CTRL_FILHIT_MASK);
+}
+
 enum MCP2515_ERROR setConfigMode()
 {
     return setMode(CANCTRL_REQOP_CONFIG);
@@ -362,19 +582,22 @@ enum MCP2515_ERROR setNormalMode()
 
 enum MCP2515_ERROR setMode(const enum CANCTRL_REQOP_MODE mode)
 {
-    modifyRegister(MCP_CANCTRL, CANCTRL_REQOP, mode);
+    // the request and the first look at CANSTAT go out in one burst
+    uint8_t ops[MCP_TRANSACTION_BYTES(2, 2)];
+    struct mcp_transaction transaction;
+    beginTransaction(&transaction, ops, sizeof ops);
+    queueModify(&transaction, MCP_CANCTRL, CANCTRL_REQOP, mode);
+    queueRead(&transaction, MCP_CANSTAT, 1);
+    uint8_t newmode;
+    runTransaction(&transaction, &newmode);
 
     unsigned long endTime = millis() + 10;
-    bool modeMatch = false;
-    while (millis() < endTime) {
-        uint8_t newmode = readRegister(MCP_CANSTAT);
+    bool modeMatch = (newmode & CANSTAT_OPMOD) == mode;
+    while (!modeMatch && millis() < endTime) {
+        newmode = readRegister(MCP_CANSTAT);
         newmode &= CANSTAT_OPMOD;
 
         modeMatch = newmode == mode;
-
-        if (modeMatch) {
-            break;
-        }
     }
 
     return modeMatch ? MCP2515_ERROR_OK : MCP2515_ERROR_FAIL;
@@ -387,291 +610,123 @@ enum MCP2515_ERROR setBitrate(const enum CAN_SPEED canSpeed)
 }
 
 enum MCP2515_ERROR setBitrateWithCANClock(const enum CAN_SPEED canSpeed, enum CAN_CLOCK canClock)
+{
+    if (canClock > MCP_8MHZ || canSpeed > CAN_1000KBPS) {
+        return MCP2515_ERROR_FAIL;
+    }
+    struct bit_timing timing;
+    memcpy_P(&timing, &bitTimings[canClock][canSpeed], sizeof timing);
+    if (timing.cnf2 == 0) {
+        return MCP2515_ERROR_FAIL;
+    }
+    return setBitTiming(&timing);
+}
+
+/*
+ * Writes CNF3, CNF2 and CNF1, which are consecutive registers, in a single
+ * WRITE instruction.
+ */
+enum MCP2515_ERROR setBitTiming(const struct bit_timing *timing)
 {
     enum MCP2515_ERROR error = setConfigMode();
     if (error != MCP2515_ERROR_OK) {
         return error;
     }
 
-    uint8_t set, cfg1, cfg2, cfg3;
-    set = 1;
-    switch (canClock)
-    {
-        case (MCP_8MHZ):
-            switch (canSpeed)
-            {
-                case (CAN_5KBPS):                                               //   5KBPS
-                    cfg1 = MCP_8MHz_5kBPS_CFG1;
-                    cfg2 = MCP_8MHz_5kBPS_CFG2;
-                    cfg3 = MCP_8MHz_5kBPS_CFG3;
-                    break;
-
-                case (CAN_10KBPS):                                              //  10KBPS
-                    cfg1 = MCP_8MHz_10kBPS_CFG1;
-                    cfg2 = MCP_8MHz_10kBPS_CFG2;
-                    cfg3 = MCP_8MHz_10kBPS_CFG3;
-                    break;
-
-                case (CAN_20KBPS):                                              //  20KBPS
-                    cfg1 = MCP_8MHz_20kBPS_CFG1;
-                    cfg2 = MCP_8MHz_20kBPS_CFG2;
-                    cfg3 = MCP_8MHz_20kBPS_CFG3;
-                    break;
-
-                case (CAN_31K25BPS):                                            //  31.25KBPS
-                    cfg1 = MCP_8MHz_31k25BPS_CFG1;
-                    cfg2 = MCP_8MHz_31k25BPS_CFG2;
-                    cfg3 = MCP_8MHz_31k25BPS_CFG3;
-                    break;
-
-                case (CAN_33KBPS):                                              //  33.333KBPS
-                    cfg1 = MCP_8MHz_33k3BPS_CFG1;
-                    cfg2 = MCP_8MHz_33k3BPS_CFG2;
-                    cfg3 = MCP_8MHz_33k3BPS_CFG3;
-                    break;
-
-                case (CAN_40KBPS):                                              //  40Kbps
-                    cfg1 = MCP_8MHz_40kBPS_CFG1;
-                    cfg2 = MCP_8MHz_40kBPS_CFG2;
-                    cfg3 = MCP_8MHz_40kBPS_CFG3;
-                    break;
-
-                case (CAN_50KBPS):                                              //  50Kbps
-                    cfg1 = MCP_8MHz_50kBPS_CFG1;
-                    cfg2 = MCP_8MHz_50kBPS_CFG2;
-                    cfg3 = MCP_8MHz_50kBPS_CFG3;
-                    break;
-
-                case (CAN_80KBPS):                                              //  80Kbps
-                    cfg1 = MCP_8MHz_80kBPS_CFG1;
-                    cfg2 = MCP_8MHz_80kBPS_CFG2;
-                    cfg3 = MCP_8MHz_80kBPS_CFG3;
-                    break;
-
-                case (CAN_100KBPS):                                             // 100Kbps
-                    cfg1 = MCP_8MHz_100kBPS_CFG1;
-                    cfg2 = MCP_8MHz_100kBPS_CFG2;
-                    cfg3 = MCP_8MHz_100kBPS_CFG3;
-                    break;
-
-                case (CAN_125KBPS):                                             // 125Kbps
-                    cfg1 = MCP_8MHz_125kBPS_CFG1;
-                    cfg2 = MCP_8MHz_125kBPS_CFG2;
-                    cfg3 = MCP_8MHz_125kBPS_CFG3;
-                    break;
-
-                case (CAN_200KBPS):                                             // 200Kbps
-                    cfg1 = MCP_8MHz_200kBPS_CFG1;
-                    cfg2 = MCP_8MHz_200kBPS_CFG2;
-                    cfg3 = MCP_8MHz_200kBPS_CFG3;
-                    break;
-
-                case (CAN_250KBPS):                                             // 250Kbps
-                    cfg1 = MCP_8MHz_250kBPS_CFG1;
-                    cfg2 = MCP_8MHz_250kBPS_CFG2;
-                    cfg3 = MCP_8MHz_250kBPS_CFG3;
-                    break;
-
-                case (CAN_500KBPS):                                             // 500Kbps
-                    cfg1 = MCP_8MHz_500kBPS_CFG1;
-                    cfg2 = MCP_8MHz_500kBPS_CFG2;
-                    cfg3 = MCP_8MHz_500kBPS_CFG3;
-                    break;
-
-                case (CAN_1000KBPS):                                            //   1Mbps
-                    cfg1 = MCP_8MHz_1000kBPS_CFG1;
-                    cfg2 = MCP_8MHz_1000kBPS_CFG2;
-                    cfg3 = MCP_8MHz_1000kBPS_CFG3;
-                    break;
-
-                default:
-                    set = 0;
-                    break;
-            }
-            break;
+    const uint8_t cnf[] = {timing->cnf3, timing->cnf2, timing->cnf1};
+    setRegisters(MCP_CNF3, cnf, sizeof cnf);
+    return MCP2515_ERROR_OK;
+}
 
-        case (MCP_16MHZ):
-            switch (canSpeed)
-            {
-                case (CAN_5KBPS):                                               //   5Kbps
-                    cfg1 = MCP_16MHz_5kBPS_CFG1;
-                    cfg2 = MCP_16MHz_5kBPS_CFG2;
-                    cfg3 = MCP_16MHz_5kBPS_CFG3;
-                    break;
-
-                case (CAN_10KBPS):                                              //  10Kbps
-                    cfg1 = MCP_16MHz_10kBPS_CFG1;
-                    cfg2 = MCP_16MHz_10kBPS_CFG2;
-                    cfg3 = MCP_16MHz_10kBPS_CFG3;
-                    break;
-
-                case (CAN_20KBPS):                                              //  20Kbps
-                    cfg1 = MCP_16MHz_20kBPS_CFG1;
-                    cfg2 = MCP_16MHz_20kBPS_CFG2;
-                    cfg3 = MCP_16MHz_20kBPS_CFG3;
-                    break;
-
-                case (CAN_33KBPS):                                              //  33.333Kbps
-                    cfg1 = MCP_16MHz_33k3BPS_CFG1;
-                    cfg2 = MCP_16MHz_33k3BPS_CFG2;
-                    cfg3 = MCP_16MHz_33k3BPS_CFG3;
-                    break;
-
-                case (CAN_40KBPS):                                              //  40Kbps
-                    cfg1 = MCP_16MHz_40kBPS_CFG1;
-                    cfg2 = MCP_16MHz_40kBPS_CFG2;
-                    cfg3 = MCP_16MHz_40kBPS_CFG3;
-                    break;
-
-                case (CAN_50KBPS):                                              //  50Kbps
-                    cfg1 = MCP_16MHz_50kBPS_CFG1;
-                    cfg2 = MCP_16MHz_50kBPS_CFG2;
-                    cfg3 = MCP_16MHz_50kBPS_CFG3;
-                    break;
-
-                case (CAN_80KBPS):                                              //  80Kbps
-                    cfg1 = MCP_16MHz_80kBPS_CFG1;
-                    cfg2 = MCP_16MHz_80kBPS_CFG2;
-                    cfg3 = MCP_16MHz_80kBPS_CFG3;
-                    break;
-
-                case (CAN_83K3BPS):                                             //  83.333Kbps
-                    cfg1 = MCP_16MHz_83k3BPS_CFG1;
-                    cfg2 = MCP_16MHz_83k3BPS_CFG2;
-                    cfg3 = MCP_16MHz_83k3BPS_CFG3;
-                    break;
-
-                case (CAN_100KBPS):                                             // 100Kbps
-                    cfg1 = MCP_16MHz_100kBPS_CFG1;
-                    cfg2 = MCP_16MHz_100kBPS_CFG2;
-                    cfg3 = MCP_16MHz_100kBPS_CFG3;
-                    break;
-
-                case (CAN_125KBPS):                                             // 125Kbps
-                    cfg1 = MCP_16MHz_125kBPS_CFG1;
-                    cfg2 = MCP_16MHz_125kBPS_CFG2;
-                    cfg3 = MCP_16MHz_125kBPS_CFG3;
-                    break;
-
-                case (CAN_200KBPS):                                             // 200Kbps
-                    cfg1 = MCP_16MHz_200kBPS_CFG1;
-                    cfg2 = MCP_16MHz_200kBPS_CFG2;
-                    cfg3 = MCP_16MHz_200kBPS_CFG3;
-                    break;
-
-                case (CAN_250KBPS):                                             // 250Kbps
-                    cfg1 = MCP_16MHz_250kBPS_CFG1;
-                    cfg2 = MCP_16MHz_250kBPS_CFG2;
-                    cfg3 = MCP_16MHz_250kBPS_CFG3;
-                    break;
-
-                case (CAN_500KBPS):                                             // 500Kbps
-                    cfg1 = MCP_16MHz_500kBPS_CFG1;
-                    cfg2 = MCP_16MHz_500kBPS_CFG2;
-                    cfg3 = MCP_16MHz_500kBPS_CFG3;
-                    break;
-
-                case (CAN_1000KBPS):                                            //   1Mbps
-                    cfg1 = MCP_16MHz_1000kBPS_CFG1;
-                    cfg2 = MCP_16MHz_1000kBPS_CFG2;
-                    cfg3 = MCP_16MHz_1000kBPS_CFG3;
-                    break;
-
-                default:
-                    set = 0;
-                    break;
-            }
-            break;
+/*
+ * Phase segment 2 placing the sample point closest to samplePoint (per
+ * mille) within the segment limits for a bit of tq quanta: PS2 2..8 and
+ * above sjw, PRSEG and PS1 1..8 each with PS1 >= sjw, PRSEG + PS1 >= PS2.
+ * Returns 0 when tq cannot be split that way.
+ */
+static uint8_t phaseSegment2(const uint8_t tq, const uint16_t samplePoint, const uint8_t sjw)
+{
+    uint8_t ps2 = tq - (uint8_t) (((uint32_t) tq * samplePoint + 500) / 1000);
+    if (ps2 < 2) {
+        ps2 = 2;
+    }
+    if (ps2 > 8) {
+        ps2 = 8;
+    }
+    if (ps2 > (tq - 1) / 2) { /* PRSEG + PS1 >= PS2 */
+        ps2 = (tq - 1) / 2;
+    }
+    if (ps2 + 17 < tq) { /* PRSEG + PS1 <= 16 */
+        ps2 = tq - 17;
+    }
+    uint8_t tseg1 = tq - 1 - ps2;
+    if (ps2 < 2 || ps2 > 8 || tseg1 < ps2 || tseg1 > 16 || sjw >= ps2 || sjw > tseg1 / 2) {
+        return 0;
+    }
+    return ps2;
+}
 
-        case (MCP_20MHZ):
-            switch (canSpeed)
-            {
-                case (CAN_33KBPS):                                              //  33.333Kbps
-                    cfg1 = MCP_20MHz_33k3BPS_CFG1;
-                    cfg2 = MCP_20MHz_33k3BPS_CFG2;
-                    cfg3 = MCP_20MHz_33k3BPS_CFG3;
-                    break;
-
-                case (CAN_40KBPS):                                              //  40Kbps
-                    cfg1 = MCP_20MHz_40kBPS_CFG1;
-                    cfg2 = MCP_20MHz_40kBPS_CFG2;
-                    cfg3 = MCP_20MHz_40kBPS_CFG3;
-                    break;
-
-                case (CAN_50KBPS):                                              //  50Kbps
-                    cfg1 = MCP_20MHz_50kBPS_CFG1;
-                    cfg2 = MCP_20MHz_50kBPS_CFG2;
-                    cfg3 = MCP_20MHz_50kBPS_CFG3;
-                    break;
-
-                case (CAN_80KBPS):                                              //  80Kbps
-                    cfg1 = MCP_20MHz_80kBPS_CFG1;
-                    cfg2 = MCP_20MHz_80kBPS_CFG2;
-                    cfg3 = MCP_20MHz_80kBPS_CFG3;
-                    break;
-
-                case (CAN_83K3BPS):                                             //  83.333Kbps
-                    cfg1 = MCP_20MHz_83k3BPS_CFG1;
-                    cfg2 = MCP_20MHz_83k3BPS_CFG2;
-                    cfg3 = MCP_20MHz_83k3BPS_CFG3;
-                    break;
-
-                case (CAN_100KBPS):                                             // 100Kbps
-                    cfg1 = MCP_20MHz_100kBPS_CFG1;
-                    cfg2 = MCP_20MHz_100kBPS_CFG2;
-                    cfg3 = MCP_20MHz_100kBPS_CFG3;
-                    break;
-
-                case (CAN_125KBPS):                                             // 125Kbps
-                    cfg1 = MCP_20MHz_125kBPS_CFG1;
-                    cfg2 = MCP_20MHz_125kBPS_CFG2;
-                    cfg3 = MCP_20MHz_125kBPS_CFG3;
-                    break;
-
-                case (CAN_200KBPS):                                             // 200Kbps
-                    cfg1 = MCP_20MHz_200kBPS_CFG1;
-                    cfg2 = MCP_20MHz_200kBPS_CFG2;
-                    cfg3 = MCP_20MHz_200kBPS_CFG3;
-                    break;
-
-                case (CAN_250KBPS):                                             // 250Kbps
-                    cfg1 = MCP_20MHz_250kBPS_CFG1;
-                    cfg2 = MCP_20MHz_250kBPS_CFG2;
-                    cfg3 = MCP_20MHz_250kBPS_CFG3;
-                    break;
-
-                case (CAN_500KBPS):                                             // 500Kbps
-                    cfg1 = MCP_20MHz_500kBPS_CFG1;
-                    cfg2 = MCP_20MHz_500kBPS_CFG2;
-                    cfg3 = MCP_20MHz_500kBPS_CFG3;
-                    break;
-
-                case (CAN_1000KBPS):                                            //   1Mbps
-                    cfg1 = MCP_20MHz_1000kBPS_CFG1;
-                    cfg2 = MCP_20MHz_1000kBPS_CFG2;
-                    cfg3 = MCP_20MHz_1000kBPS_CFG3;
-                    break;
-
-                default:
-                    set = 0;
-                    break;
-            }
-            break;
+/*
+ * Derives CNF1..3 for an arbitrary bitrate. Every bit length from 5 to 25
+ * time quanta that fits the segment limits is tried; the prescaler with the
+ * smallest bitrate error wins, ties going to the sample point closest to
+ * samplePoint (per mille). The bitrate error has to stay within 0.5%.
+ */
+enum MCP2515_ERROR calculateBitTiming(const enum CAN_CLOCK canClock, const uint32_t bitrate,
+                                      const uint16_t samplePoint, uint8_t sjw, const bool tripleSample,
+                                      struct bit_timing *timing)
+{
+    if (canClock > MCP_8MHZ || bitrate == 0 || samplePoint >= 1000) {
+        return MCP2515_ERROR_FAIL;
+    }
+    const uint32_t clock = pgm_read_dword(&canClockFrequency[canClock]);
 
-        default:
-            set = 0;
-            break;
+    if (sjw == 0) {
+        sjw = 1;
+    }
+    if (sjw > 4) {
+        sjw = 4;
     }
 
-    if (set) {
-        setRegister(MCP_CNF1, cfg1);
-        setRegister(MCP_CNF2, cfg2);
-        setRegister(MCP_CNF3, cfg3);
-        return MCP2515_ERROR_OK;
+    uint32_t bestError = UINT32_MAX;
+    uint16_t bestSampleError = UINT16_MAX;
+    uint8_t bestBrp = 0;
+    uint8_t tq = 0;
+    uint8_t ps2 = 0;
+    for (uint8_t n = BIT_TIMING_MAX_TQ; n >= BIT_TIMING_MIN_TQ; n--) {
+        uint8_t nPs2 = phaseSegment2(n, samplePoint, sjw);
+        if (nPs2 == 0) {
+            continue;
+        }
+        uint32_t step = 2UL * n * bitrate;
+        uint32_t brp = (clock + step / 2) / step;
+        if (brp == 0 || brp > BIT_TIMING_MAX_BRP) {
+            continue;
+        }
+        uint32_t actual = clock / (2UL * n * brp);
+        uint32_t error = (actual > bitrate) ? actual - bitrate : bitrate - actual;
+        uint16_t sample = (uint16_t) (n - nPs2) * 1000 / n;
+        uint16_t sampleError = (sample > samplePoint) ? sample - samplePoint : samplePoint - sample;
+        if (error < bestError || (error == bestError && sampleError < bestSampleError)) {
+            bestError = error;
+            bestSampleError = sampleError;
+            bestBrp = brp;
+            tq = n;
+            ps2 = nPs2;
+        }
     }
-    else {
+    if (tq == 0 || bestError * 200 > bitrate) {
         return MCP2515_ERROR_FAIL;
     }
+
+    uint8_t tseg1 = tq - 1 - ps2;
+    uint8_t ps1 = tseg1 / 2;
+    uint8_t prseg = tseg1 - ps1;
+
+    timing->cnf1 = ((sjw - 1) << 6) | (bestBrp - 1);
+    timing->cnf2 = CNF2_BTLMODE | (tripleSample ? CNF2_SAM : 0) | ((ps1 - 1) << 3) | (prseg - 1);
+    timing->cnf3 = ps2 - 1;
+    return MCP2515_ERROR_OK;
 }
 
 enum MCP2515_ERROR setClkOut(const enum CAN_CLKOUT divisor)
@@ -765,60 +820,147 @@ enum MCP2515_ERROR setFilter(const enum RXF num, const bool ext, const uint32_t
     return MCP2515_ERROR_OK;
 }
 
-enum MCP2515_ERROR sendMessageThroughTXBn(const enum TXBn txbn, const struct can_frame *frame)
+/*
+ * Writes both masks, which are always extended, and all six filters, RXFn
+ * extended when bit n of extFilters is set, with one configuration mode
+ * check. RXF0..2, RXF3..5 and RXM0..1 are three WRITEs.
+ */
+enum MCP2515_ERROR setFilters(const uint32_t masks[2], const uint32_t filters[6], const uint8_t extFilters)
+{
+    enum MCP2515_ERROR res = setConfigMode();
+    if (res != MCP2515_ERROR_OK) {
+        return res;
+    }
+
+    uint8_t ops[MCP_TRANSACTION_BYTES(3, 8 * 4)];
+    struct mcp_transaction transaction;
+    beginTransaction(&transaction, ops, sizeof ops);
+    const enum REGISTER filterRegs[6] = {MCP_RXF0SIDH, MCP_RXF1SIDH, MCP_RXF2SIDH,
+                                         MCP_RXF3SIDH, MCP_RXF4SIDH, MCP_RXF5SIDH};
+    uint8_t tbufdata[4];
+    for (uint8_t i = 0; i < 6; i++) {
+        prepareId(tbufdata, (extFilters >> i) & 1, filters[i]);
+        queueWrite(&transaction, filterRegs[i], tbufdata, 4);
+    }
+    prepareId(tbufdata, true, masks[0]);
+    queueWrite(&transaction, MCP_RXM0SIDH, tbufdata, 4);
+    prepareId(tbufdata, true, masks[1]);
+    queueWrite(&transaction, MCP_RXM1SIDH, tbufdata, 4);
+    runTransaction(&transaction, NULL);
+
+    return MCP2515_ERROR_OK;
+}
+
+/*
+ * SIDH..D7 of a transmit buffer, the layout LOAD TX BUFFER and the
+ * TXBnSIDH register writes expect.
+ */
+enum MCP2515_ERROR prepareMessage(const struct can_frame *frame, uint8_t image[MCP_TXB_IMAGE_LENGTH])
 {
     if (frame->can_dlc > CAN_MAX_DLEN) {
         return MCP2515_ERROR_FAILTX;
     }
 
-    // const struct TXBn_REGS *txbuf = &TXB[txbn];
-    const TXB *txbuf = &TXBn_REGS[txbn];
-    uint8_t data[13];
-
     bool ext = (frame->can_id & CAN_EFF_FLAG);
     bool rtr = (frame->can_id & CAN_RTR_FLAG);
     uint32_t id = (frame->can_id & (ext ? CAN_EFF_MASK : CAN_SFF_MASK));
 
-    prepareId(data, ext, id);
+    prepareId(image, ext, id);
 
-    data[MCP_DLC] = rtr ? (frame->can_dlc | RTR_MASK) : frame->can_dlc;
+    image[MCP_DLC] = rtr ? (frame->can_dlc | RTR_MASK) : frame->can_dlc;
 
-    memcpy(&data[MCP_DATA], frame->data, frame->can_dlc);
-
-    setRegisters(txbuf->SIDH, data, 5 + frame->can_dlc);
+    memcpy(&image[MCP_DATA], frame->data, frame->can_dlc);
+    return MCP2515_ERROR_OK;
+}
 
-    modifyRegister(txbuf->CTRL, TXB_TXREQ, TXB_TXREQ);
+/*
+ * Loads the buffer with LOAD TX BUFFER and starts it with RTS (or the
+ * TXnRTS pin when MCP2515_TXRTS_PINS is defined). Transmission errors are
+ * reported later through TXBnCTRL/ERRIF, the buffer is not read back here.
+ */
+enum MCP2515_ERROR sendMessageThroughTXBn(const enum TXBn txbn, const struct can_frame *frame)
+{
+    uint8_t data[MCP_TXB_IMAGE_LENGTH];
 
-    uint8_t ctrl = readRegister(txbuf->CTRL);
-    if ((ctrl & (TXB_ABTF | TXB_MLOA | TXB_TXERR)) != 0) {
-        return MCP2515_ERROR_FAILTX;
+    enum MCP2515_ERROR result = prepareMessage(frame, data);
+    if (result != MCP2515_ERROR_OK) {
+        return result;
     }
+
+    startSPI();
+    SPI_0_exchange_byte_polled(TXBn_REGS[txbn].LOAD_TX);
+    SPI_0_write_block_polled(data, MCP_DATA + frame->can_dlc);
+    endSPI();
+
+    requestToSend(txbn);
     return MCP2515_ERROR_OK;
 }
 
+/*
+ * Writes TXBnCTRL together with the image from prepareMessage() in one
+ * WRITE, so the buffer priority is set in the same chip-select window,
+ * and starts the transmission.
+ */
+void sendImageThroughTXBn(const enum TXBn txbn, const uint8_t image[MCP_TXB_IMAGE_LENGTH], const uint8_t priority)
+{
+    uint8_t header[3] = {INSTRUCTION_WRITE, TXBn_REGS[txbn].CTRL, priority & TXB_TXP};
+
+    startSPI();
+    SPI_0_write_block_polled(header, sizeof(header));
+    SPI_0_write_block_polled(image, MCP_DATA + (image[MCP_DLC] & DLC_MASK));
+    endSPI();
+
+    requestToSend(txbn);
+}
 
+void requestToSend(const enum TXBn txbn)
+{
+#ifdef MCP2515_TXRTS_PINS
+    switch (txbn) {
+        case TXB0: TX0RTS_set_level(false); TX0RTS_set_level(true); break;
+        case TXB1: TX1RTS_set_level(false); TX1RTS_set_level(true); break;
+        case TXB2: TX2RTS_set_level(false); TX2RTS_set_level(true); break;
+    }
+#else
+    startSPI();
+    SPI_0_exchange_byte_polled(TXBn_REGS[txbn].RTS);
+    endSPI();
+#endif
+}
+
+/*
+ * One READ STATUS byte carries the TXREQ bit of all three buffers.
+ */
 enum MCP2515_ERROR sendMessage(const struct can_frame *frame)
 {
     if (frame->can_dlc > CAN_MAX_DLEN) {
         return MCP2515_ERROR_FAILTX;
     }
-    enum TXBn txBuffers[N_TXBUFFERS] = {TXB0, TXB1, TXB2};
+    uint8_t status = getStatus();
 
-    for (int i=0; i<N_TXBUFFERS; i++) {
-        const TXB *txbuf = &TXBn_REGS[txBuffers[i]];
-        uint8_t ctrlval = readRegister(txbuf->CTRL);
-        if ( (ctrlval & TXB_TXREQ) == 0 ) {
-            return sendMessageThroughTXBn(txBuffers[i], frame);
+    for (uint8_t i=0; i<N_TXBUFFERS; i++) {
+        if ( (status & TXBn_REGS[i].STAT_TXREQ) == 0 ) {
+            return sendMessageThroughTXBn((enum TXBn) i, frame);
         }
     }
     return MCP2515_ERROR_ALLTXBUSY;
 }
 
-enum MCP2515_ERROR readMessageThroughRXBn(const enum RXBn rxbn, struct can_frame *frame)
+/*
+ * DLC of the RXBnSIDH..RXBnDLC header, 9..15 is a valid classic frame that
+ * carries 8 data bytes.
+ */
+static uint8_t decodeDlc(const uint8_t tbufdata[5])
+{
+    uint8_t dlc = (tbufdata[MCP_DLC] & DLC_MASK);
+    if (dlc > CAN_MAX_DLEN) {
+        dlc = CAN_MAX_DLEN;
+    }
+    return dlc;
+}
+
+static uint32_t decodeId(const uint8_t tbufdata[5])
 {
-    const RXB *rxb = &RXBn_REGS[rxbn];
-    uint8_t tbufdata[5];
-    readRegisters(rxb->SIDH, tbufdata, 5);
     uint32_t id = (tbufdata[MCP_SIDH]<<3) + (tbufdata[MCP_SIDL]>>5);
 
     if ( (tbufdata[MCP_SIDL] & TXB_EXIDE_MASK) ==  TXB_EXIDE_MASK ) {
@@ -826,36 +968,112 @@ enum MCP2515_ERROR readMessageThroughRXBn(const enum RXBn rxbn, struct can_frame
         id = (id<<8) + tbufdata[MCP_EID8];
         id = (id<<8) + tbufdata[MCP_EID0];
         id |= CAN_EFF_FLAG;
+        if (tbufdata[MCP_DLC] & RTR_MASK) {
+            id |= CAN_RTR_FLAG;
+        }
+    } else if (tbufdata[MCP_SIDL] & RXBnSIDL_SRR) {
+        id |= CAN_RTR_FLAG;
     }
+    return id;
+}
 
-    uint8_t dlc = (tbufdata[MCP_DLC] & DLC_MASK);
-    if (dlc > CAN_MAX_DLEN) {
-        return MCP2515_ERROR_FAIL;
-    }
+/*
+ * Reads header and data in a single chip-select window with READ RX BUFFER.
+ * Raising CS at the end clears RXnIF, and RTR is taken from SIDL.SRR or
+ * DLC.RTR so RXBnCTRL does not have to be read.
+ */
+enum MCP2515_ERROR readMessageThroughRXBn(const enum RXBn rxbn, struct can_frame *frame)
+{
+    const RXB *rxb = &RXBn_REGS[rxbn];
+    uint8_t tbufdata[5];
+    startSPI();
+    SPI_0_exchange_byte_polled(rxb->READ_RX);
+    SPI_0_read_block_polled(tbufdata, 5);
 
-    uint8_t ctrl = readRegister(rxb->CTRL);
-    if (ctrl & RXBnCTRL_RTR) {
-        id |= CAN_RTR_FLAG;
+    uint8_t dlc = decodeDlc(tbufdata);
+    // the address pointer continues into RXBnD0..RXBnD7, D0 shifts in while the id is decoded
+    if (dlc != 0) {
+        SPI_0_start_byte_polled(0x00);
     }
 
-    frame->can_id = id;
+    frame->can_id = decodeId(tbufdata);
     frame->can_dlc = dlc;
 
-    readRegisters(rxb->DATA, frame->data, dlc);
-
-    modifyRegister(MCP_CANINTF, rxb->CANINTF_RXnIF, 0);
+    if (dlc != 0) {
+        frame->data[0] = SPI_0_finish_byte_polled();
+        SPI_0_read_block_polled(&frame->data[1], dlc - 1);
+    }
+    endSPI();
 
     return MCP2515_ERROR_OK;
 }
 
+#ifdef MCP2515_RX_SPI_INTERRUPT
+/*
+ * READ RX BUFFER run by ISR(SPI_STC_vect): the instruction and header in
+ * one interrupt driven exchange, the data bytes in a second one chained
+ * from its callback. The MCP2515 ignores SI while it shifts the buffer
+ * out, so what the exchange sends after the instruction does not matter.
+ */
+static void readMessageDataDone(void)
+{
+    SS_set_level(true);
+    rxReading = false;
+    rxReadDone();
+}
+
+static void readMessageHeaderDone(void)
+{
+    uint8_t dlc = decodeDlc(&rxRead[1]);
+    if (dlc == 0) {
+        readMessageDataDone();
+        return;
+    }
+    SPI_0_register_callback(readMessageDataDone);
+    SPI_0_exchange_block(&rxRead[1 + MCP_DATA], dlc);
+}
+
+/*
+ * Starts reading rxbn and returns while the bytes shift, so the caller's
+ * context gets the CPU back between them. done runs from the SPI
+ * interrupt, with interrupts disabled, once CS is raised and the buffer
+ * is free again; it takes the frame with finishReadMessage(). Until then
+ * the bus belongs to the read and startSPI()/holdInterrupt() wait for it.
+ * Called with the pin change interrupt masked.
+ */
+void startReadMessage(const enum RXBn rxbn, void (*done)(void))
+{
+    rxRead[0] = RXBn_REGS[rxbn].READ_RX;
+    rxReadDone = done;
+    rxReading = true;
+    SPI_0_register_callback(readMessageHeaderDone);
+    SS_set_level(false);
+    SPI_0_exchange_block(rxRead, 1 + MCP_DATA);
+}
+
+void finishReadMessage(struct can_frame *frame)
+{
+    const uint8_t *tbufdata = &rxRead[1];
+    uint8_t dlc = decodeDlc(tbufdata);
+    frame->can_id = decodeId(tbufdata);
+    frame->can_dlc = dlc;
+    memcpy(frame->data, &tbufdata[MCP_DATA], dlc);
+}
+
+bool readMessageRunning(void)
+{
+    return rxReading;
+}
+#endif
+
 enum MCP2515_ERROR readMessage(struct can_frame *frame)
 {
     enum MCP2515_ERROR rc;
-    uint8_t stat = getStatus();
+    uint8_t stat = getRxStatus();
 
-    if ( stat & STAT_RX0IF ) {
+    if ( stat & RXSTATUS_RXB0 ) {
         rc = readMessageThroughRXBn(RXB0, frame);
-    } else if ( stat & STAT_RX1IF ) {
+    } else if ( stat & RXSTATUS_RXB1 ) {
         rc = readMessageThroughRXBn(RXB1, frame);
     } else {
         rc = MCP2515_ERROR_NOMSG;
@@ -895,6 +1113,59 @@ void clearRXnOVRFlags(void)
     modifyRegister(MCP_EFLG, EFLG_RX0OVR | EFLG_RX1OVR, 0);
 }
 
+bool isInterruptAsserted(void)
+{
+    return !INT_get_level();
+}
+
+/*
+ * CANINTF_RX0IF/CANINTF_RX1IF for the buffers whose RXnBF pin is low,
+ * taken from the port without SPI traffic.
+ */
+uint8_t getFullRxBuffers(void)
+{
+    return (RX0BF_get_level() ? 0 : CANINTF_RX0IF) | (RX1BF_get_level() ? 0 : CANINTF_RX1IF);
+}
+
+/*
+ * Clears TXREQ of the pending buffers among txbuffers (CANINTF_TXnIF
+ * bits), with onlyFailed only of those whose last attempt ended in a bus
+ * error (TXERR). Returns, as CANINTF_TXnIF bits, the buffers that hold an
+ * aborted frame (ABTF) afterwards. A buffer that is on the bus when it is
+ * aborted finishes that attempt first, and sets TXnIF or ABTF later.
+ */
+uint8_t abortTransmissions(const uint8_t txbuffers, const bool onlyFailed)
+{
+    uint8_t ctrl[N_TXBUFFERS];
+    uint8_t ops[MCP_TRANSACTION_BYTES(2 * N_TXBUFFERS, 2 * N_TXBUFFERS)];
+    struct mcp_transaction transaction;
+    beginTransaction(&transaction, ops, sizeof ops);
+    for (uint8_t i = 0; i < N_TXBUFFERS; i++) {
+        queueRead(&transaction, TXBn_REGS[i].CTRL, 1);
+    }
+    runTransaction(&transaction, ctrl);
+
+    beginTransaction(&transaction, ops, sizeof ops);
+    for (uint8_t i = 0; i < N_TXBUFFERS; i++) {
+        if ((txbuffers & (CANINTF_TX0IF << i)) && (ctrl[i] & TXB_TXREQ)
+            && (!onlyFailed || (ctrl[i] & TXB_TXERR))) {
+            queueModify(&transaction, TXBn_REGS[i].CTRL, TXB_TXREQ, 0);
+        }
+    }
+    for (uint8_t i = 0; i < N_TXBUFFERS; i++) {
+        queueRead(&transaction, TXBn_REGS[i].CTRL, 1);
+    }
+    runTransaction(&transaction, ctrl);
+
+    uint8_t aborted = 0;
+    for (uint8_t i = 0; i < N_TXBUFFERS; i++) {
+        if ((ctrl[i] & (TXB_ABTF | TXB_TXREQ)) == TXB_ABTF) {
+            aborted |= CANINTF_TX0IF << i;
+        }
+    }
+    return aborted & txbuffers;
+}
+
 uint8_t getInterrupts(void)
 {
     return readRegister(MCP_CANINTF);
@@ -915,6 +1186,15 @@ void clearTXInterrupts(void)
     modifyRegister(MCP_CANINTF, (CANINTF_TX0IF | CANINTF_TX1IF | CANINTF_TX2IF), 0);
 }
 
+/*
+ * Clears only the given TXnIF bits, a buffer that completed after
+ * getInterrupts() keeps its flag.
+ */
+void clearTXnIF(const uint8_t txif)
+{
+    modifyRegister(MCP_CANINTF, txif & (CANINTF_TX0IF | CANINTF_TX1IF | CANINTF_TX2IF), 0);
+}
+
 void clearRXnOVR(void)
 {
     uint8_t eflg = getErrorFlags();
@@ -933,6 +1213,11 @@ void clearMERR()
     modifyRegister(MCP_CANINTF, CANINTF_MERRF, 0);
 }
 
+void clearWAKIF()
+{
+    modifyRegister(MCP_CANINTF, CANINTF_WAKIF, 0);
+}
+
 void clearERRIF()
 {
     //modifyRegister(MCP_EFLG, EFLG_RX0OVR | EFLG_RX1OVR, 0);
@@ -950,3 +1235,20 @@ uint8_t errorCountTX(void)
     return readRegister(MCP_TEC);
 }
 
+/*
+ * Reads EFLG and clears RX0OVR, RX1OVR and ERRIF in one burst. Returns
+ * EFLG as it was before.
+ */
+uint8_t acknowledgeErrors(void)
+{
+    uint8_t ops[MCP_TRANSACTION_BYTES(3, 4)];
+    struct mcp_transaction transaction;
+    beginTransaction(&transaction, ops, sizeof ops);
+    queueRead(&transaction, MCP_EFLG, 1);
+    queueModify(&transaction, MCP_EFLG, EFLG_RX0OVR | EFLG_RX1OVR, 0);
+    queueModify(&transaction, MCP_CANINTF, CANINTF_ERRIF, 0);
+    uint8_t eflg;
+    runTransaction(&transaction, &eflg);
+    return eflg;
+}
+
@@ -0,0 +1,75 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "rxring.h"
+#include <atomic.h>
+
+static struct rx_frame rxring_buf[RXRING_SIZE];
+static volatile uint8_t rxring_head;
+static volatile uint8_t rxring_tail;
+static volatile uint16_t rxring_lost;
+
+void rxring_init(void)
+{
+    rxring_head = 0;
+    rxring_tail = 0;
+    rxring_lost = 0;
+}
+
+/*
+ * Producer side. Returns the slot to fill or NULL when the ring is full;
+ * the frame becomes visible to the consumer only after rxring_commit().
+ * A frame that should have gone into the ring but found it full is
+ * counted with rxring_drop().
+ */
+struct rx_frame *rxring_reserve(void)
+{
+    uint8_t head = rxring_head;
+    if ((uint8_t) (head - rxring_tail) == RXRING_SIZE) {
+        return NULL;
+    }
+    return &rxring_buf[head & RXRING_MASK];
+}
+
+void rxring_commit(void)
+{
+    rxring_head++;
+}
+
+void rxring_drop(void)
+{
+    rxring_lost++;
+}
+
+/*
+ * Consumer side. Returns the oldest frame or NULL when the ring is empty;
+ * the slot stays owned by the consumer until rxring_release().
+ */
+struct rx_frame *rxring_peek(void)
+{
+    uint8_t tail = rxring_tail;
+    if (tail == rxring_head) {
+        return NULL;
+    }
+    return &rxring_buf[tail & RXRING_MASK];
+}
+
+void rxring_release(void)
+{
+    rxring_tail++;
+}
+
+uint8_t rxring_count(void)
+{
+    return (uint8_t) (rxring_head - rxring_tail);
+}
+
+uint16_t rxring_overflows(void)
+{
+    uint16_t lost;
+    ENTER_CRITICAL(R);
+    lost = rxring_lost;
+    EXIT_CRITICAL(R);
+    return lost;
+}
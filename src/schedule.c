@@ -0,0 +1,184 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "schedule.h"
+#include <stddef.h>
+#include <atomic.h>
+
+struct schedule_entry {
+    struct can_frame frame;
+    uint32_t due;
+    uint16_t period; // 0 for a free slot
+    uint16_t offset;
+    uint8_t counterByte;
+    uint8_t checksumByte;
+};
+
+static struct schedule_entry schedule_table[SCHEDULE_SIZE];
+static volatile bool schedule_running;
+static uint32_t schedule_epoch;
+// slots that fell due and wait for a transmit buffer, bit n for slot n
+static volatile uint16_t schedule_pending;
+
+static void schedule_prepare(struct schedule_entry *entry);
+
+void schedule_init(void)
+{
+    ENTER_CRITICAL(I);
+    for (uint8_t i = 0; i < SCHEDULE_SIZE; i++) {
+        schedule_table[i].period = 0;
+    }
+    schedule_running = false;
+    schedule_pending = 0;
+    EXIT_CRITICAL(I);
+}
+
+/*
+ * Fills the slot, replacing what it held. Returns false for a slot out of
+ * range, a zero period or counter/checksum bytes outside the frame data.
+ * The new frame keeps the configured phase: it is first due at the next
+ * time, not before now, that lies offset ms plus a whole number of
+ * periods after schedule_start().
+ */
+bool schedule_set(const uint8_t slot, const struct can_frame *frame, const uint16_t period, const uint16_t offset,
+                  const uint8_t counterByte, const uint8_t checksumByte, const uint32_t now)
+{
+    bool rtr = (frame->can_id & CAN_RTR_FLAG) != 0;
+    if (slot >= SCHEDULE_SIZE || period == 0 || frame->can_dlc > CAN_MAX_DLEN) {
+        return false;
+    }
+    if (counterByte != SCHEDULE_NO_BYTE && (rtr || counterByte >= frame->can_dlc)) {
+        return false;
+    }
+    if (checksumByte != SCHEDULE_NO_BYTE && (rtr || checksumByte >= frame->can_dlc || checksumByte == counterByte)) {
+        return false;
+    }
+    // built aside, the Timer1 interrupt only sees the finished slot
+    struct schedule_entry entry;
+    entry.frame = *frame;
+    entry.period = period;
+    entry.offset = offset;
+    entry.counterByte = counterByte;
+    entry.checksumByte = checksumByte;
+    entry.due = schedule_epoch + offset;
+    uint32_t late = now - entry.due;
+    if ((int32_t) late > 0) {
+        entry.due += (late + period - 1) / period * period;
+    }
+    ENTER_CRITICAL(S);
+    schedule_table[slot] = entry;
+    schedule_pending &= ~(1 << slot);
+    EXIT_CRITICAL(S);
+    return true;
+}
+
+void schedule_remove(const uint8_t slot)
+{
+    if (slot < SCHEDULE_SIZE) {
+        ENTER_CRITICAL(R);
+        schedule_table[slot].period = 0;
+        schedule_pending &= ~(1 << slot);
+        EXIT_CRITICAL(R);
+    }
+}
+
+/*
+ * All offsets count from the same start, so the relative phase of the
+ * slots is the configured one.
+ */
+void schedule_start(const uint32_t now)
+{
+    ENTER_CRITICAL(S);
+    schedule_epoch = now;
+    for (uint8_t i = 0; i < SCHEDULE_SIZE; i++) {
+        schedule_table[i].due = now + schedule_table[i].offset;
+    }
+    schedule_pending = 0;
+    schedule_running = true;
+    EXIT_CRITICAL(S);
+}
+
+void schedule_stop(void)
+{
+    ENTER_CRITICAL(S);
+    schedule_running = false;
+    schedule_pending = 0;
+    EXIT_CRITICAL(S);
+}
+
+/*
+ * Timer1 side, once per millisecond: marks the slots whose time has come.
+ * Due times advance by whole periods so there is no drift; a slot still
+ * waiting for a transmit buffer when it is due again skips that cycle
+ * instead of sending two frames back to back. Returns true while frames
+ * wait.
+ */
+bool schedule_tick(const uint32_t now)
+{
+    if (!schedule_running) {
+        return false;
+    }
+    uint16_t due = 0;
+    for (uint8_t i = 0; i < SCHEDULE_SIZE; i++) {
+        struct schedule_entry *entry = &schedule_table[i];
+        if (entry->period == 0 || (int32_t) (now - entry->due) < 0) {
+            continue;
+        }
+        due |= 1 << i;
+        entry->due += entry->period;
+        if ((int32_t) (now - entry->due) >= 0) {
+            entry->due = now + entry->period;
+        }
+    }
+    uint16_t pending;
+    ENTER_CRITICAL(T);
+    pending = schedule_pending | due;
+    schedule_pending = pending;
+    EXIT_CRITICAL(T);
+    return pending != 0;
+}
+
+/*
+ * Transmit side, with the MCP2515 held: takes the lowest waiting slot,
+ * steps its counter and checksum and returns its frame, NULL when none
+ * waits.
+ */
+const struct can_frame *schedule_take(void)
+{
+    uint16_t pending;
+    uint8_t slot = 0;
+    ENTER_CRITICAL(T);
+    pending = schedule_pending;
+    if (pending != 0) {
+        while (!(pending & (1 << slot))) {
+            slot++;
+        }
+        schedule_pending = pending & ~(1 << slot);
+    }
+    EXIT_CRITICAL(T);
+    if (pending == 0) {
+        return NULL;
+    }
+    struct schedule_entry *entry = &schedule_table[slot];
+    schedule_prepare(entry);
+    return &entry->frame;
+}
+
+static void schedule_prepare(struct schedule_entry *entry)
+{
+    uint8_t *data = entry->frame.data;
+    if (entry->counterByte != SCHEDULE_NO_BYTE) {
+        uint8_t counter = data[entry->counterByte];
+        data[entry->counterByte] = (counter & 0xF0) | ((counter + 1) & 0x0F);
+    }
+    if (entry->checksumByte != SCHEDULE_NO_BYTE) {
+        uint8_t checksum = 0;
+        for (uint8_t i = 0; i < entry->frame.can_dlc; i++) {
+            if (i != entry->checksumByte) {
+                checksum ^= data[i];
+            }
+        }
+        data[entry->checksumByte] = checksum;
+    }
+}
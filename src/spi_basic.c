@@ -76,6 +76,34 @@ void SPI_0_init()
 	SPI_0_desc.cb     = NULL;
 }
 
+/**
+ * \brief Initialize SPI interface for polled transfers
+ * Same pin and mode setup as SPI_0_init(), but with the SPI interrupt
+ * disabled and the clock at fosc/2 (SPI2X). Transfers are done with the
+ * *_polled functions, which busy-wait on SPIF.
+ *
+ * \return Nothing
+ */
+void SPI_0_init_polled()
+{
+
+	/* Enable SPI */
+	PRR0 &= ~(1 << PRSPI);
+
+	SPCR = 1 << SPE                     /* SPI module enable: enabled */
+	       | 0 << DORD                  /* Data order: disabled */
+	       | 1 << MSTR                  /* Master/Slave select: enabled */
+	       | 0 << CPOL                  /* Clock polarity: disabled */
+	       | 0 << CPHA                  /* Clock phase: disabled */
+	       | 0 << SPIE                  /* SPI interrupt enable: disabled */
+	       | (0 << SPR1) | (0 << SPR0); /* SPI Clock rate selection: fosc/4 */
+
+	SPSR = (1 << SPI2X); /* Double SPI speed: fosc/2 */
+
+	SPI_0_desc.status = SPI_FREE;
+	SPI_0_desc.cb     = NULL;
+}
+
 /**
  * \brief Enable SPI_0
  * 1. If supported by the clock system, enables the clock to the SPI
@@ -112,6 +140,12 @@ void SPI_0_register_callback(spi_transfer_done_cb_t f)
 	SPI_0_desc.cb = f;
 }
 
+/*
+  The interrupt driven transfers enable the SPI interrupt when they start
+  and the handler disables it after the last byte, before the callback.
+  So after SPI_0_init_polled() one of them can run between polled
+  transfers, and the callback can go on with polled ones.
+*/
 ISR(SPI_STC_vect)
 {
 	/* SPI_0_desc.data points to array element
@@ -140,6 +174,7 @@ ISR(SPI_STC_vect)
 	// if last byte has been transferred, update status
 	// and optionally call callback
 	else {
+		SPCR &= ~(1 << SPIE);
 		SPI_0_desc.status = SPI_DONE;
 		if (SPI_0_desc.cb != NULL) {
 			SPI_0_desc.cb();
@@ -201,6 +236,7 @@ uint8_t SPI_0_exchange_byte(uint8_t data)
 	SPI_0_desc.size   = 1;
 	SPI_0_desc.type   = SPI_READ;
 	SPI_0_desc.status = SPI_BUSY;
+	SPCR |= (1 << SPIE);
 
 	SPDR = *SPI_0_desc.data;
 	while (SPI_0_desc.status == SPI_BUSY)
@@ -214,6 +250,7 @@ void SPI_0_exchange_block(void *block, uint8_t size)
 	SPI_0_desc.size   = size;
 	SPI_0_desc.type   = SPI_EXCHANGE;
 	SPI_0_desc.status = SPI_BUSY;
+	SPCR |= (1 << SPIE);
 
 	SPDR = *SPI_0_desc.data;
 }
@@ -224,6 +261,7 @@ void SPI_0_write_block(void *block, uint8_t size)
 	SPI_0_desc.size   = size;
 	SPI_0_desc.type   = SPI_WRITE;
 	SPI_0_desc.status = SPI_BUSY;
+	SPCR |= (1 << SPIE);
 
 	SPDR = *SPI_0_desc.data;
 }
@@ -234,6 +272,62 @@ void SPI_0_read_block(void *block, uint8_t size)
 	SPI_0_desc.size   = size;
 	SPI_0_desc.type   = SPI_READ;
 	SPI_0_desc.status = SPI_BUSY;
+	SPCR |= (1 << SPIE);
 
 	SPDR = 0;
 }
+
+void SPI_0_exchange_block_polled(void *block, uint8_t size)
+{
+	uint8_t *b = (uint8_t *)block;
+
+	while (size--) {
+		SPDR = *b;
+		while (!(SPSR & (1 << SPIF)))
+			;
+		*b++ = SPDR;
+	}
+}
+
+void SPI_0_write_block_polled(const void *block, uint8_t size)
+{
+	const uint8_t *b = (const uint8_t *)block;
+
+	if (size == 0) {
+		return;
+	}
+	/* The next byte is fetched while the current one shifts and goes
+	   out right after it, without a gap for the loop */
+	SPDR = *b++;
+	while (--size) {
+		uint8_t next = *b++;
+		while (!(SPSR & (1 << SPIF)))
+			;
+		(void)SPDR;
+		SPDR = next;
+	}
+	while (!(SPSR & (1 << SPIF)))
+		;
+	(void)SPDR;
+}
+
+void SPI_0_read_block_polled(void *block, uint8_t size)
+{
+	uint8_t *b = (uint8_t *)block;
+
+	if (size == 0) {
+		return;
+	}
+	/* The next byte is started before the received one is stored */
+	SPDR = 0;
+	while (--size) {
+		while (!(SPSR & (1 << SPIF)))
+			;
+		uint8_t data = SPDR;
+		SPDR = 0;
+		*b++ = data;
+	}
+	while (!(SPSR & (1 << SPIF)))
+		;
+	*b = SPDR;
+}
@@ -4,6 +4,11 @@
 
 #include <tc16.h>
 #include <utils.h>
+#include <millis.h>
+#include <atomic.h>
+
+extern volatile unsigned long timer1_millis;
+extern volatile uint32_t timer1_timestamp_millis;
 
 /**
  * \brief Initialize TIMER_0 interface
@@ -18,16 +23,16 @@ int8_t TIMER_0_init()
 
     TCCR1A = (1 << COM1A1) | (0 << COM1A0)   /* Clear OCA on Compare Match */
             | (0 << COM1B1) | (0 << COM1B0) /* Normal port operation, OCB disconnected */
-            | (0 << WGM11) | (0 << WGM10);  /* TC16 Mode 12 CTC */
+            | (0 << WGM11) | (0 << WGM10);  /* TC16 Mode 4 CTC */
 
-            TCCR1B = (1 << WGM13) | (1 << WGM12)                /* TC16 Mode 12 CTC */
+            TCCR1B = (0 << WGM13) | (1 << WGM12)                /* TC16 Mode 4 CTC, TOP = OCR1A */
                     | 0 << ICNC1                               /* Input Capture Noise Canceler: disabled */
                     | 0 << ICES1                               /* Input Capture Edge Select: disabled */
                     | (0 << CS12) | (1 << CS11) | (0 << CS10); /* IO clock divided by 8 */
 
                     // ICR1 = 0x0; /* Top counter value: 0x0 */
 
-                    OCR1A = 0x733; /* Output compare A: 0x733 */
+                    OCR1A = TIMER_0_TOP; /* Output compare A: 1 ms */
 
                     // OCR1B = 0x0; /* Output compare B: 0x0 */
 
@@ -42,3 +47,36 @@ int8_t TIMER_0_init()
 
                             return 0;
 }
+
+unsigned long millis()
+{
+    unsigned long millis_return;
+    ENTER_CRITICAL(R);
+    millis_return = timer1_millis;
+    EXIT_CRITICAL(R);
+    return millis_return;
+}
+
+/*
+ * Microseconds from the millisecond count plus the running TCNT1, so the
+ * resolution is one timer tick (0.54 us). Safe to call from interrupt
+ * handlers; a compare match that is pending but not yet serviced is
+ * accounted for.
+ */
+uint32_t micros()
+{
+    uint32_t ms;
+    uint16_t ticks;
+    ENTER_CRITICAL(R);
+    ms = timer1_timestamp_millis;
+    ticks = TCNT1;
+    if ((TIFR1 & (1 << OCF1A)) && ticks < TIMER_0_TICKS_PER_MS / 2) {
+        ms++;
+    }
+    EXIT_CRITICAL(R);
+    if (ms == TIMESTAMP_WRAP_MILLIS) {
+        ms = 0;
+    }
+    /* ticks * 1000 / 1843.2 without a 32 bit division */
+    return ms * 1000 + (((uint32_t) ticks * 17778) >> 15);
+}
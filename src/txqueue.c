@@ -0,0 +1,171 @@
+//
+// Created by marcin on 16.10.2026.
+//
+
+#include "txqueue.h"
+#include "schedule.h"
+
+#define TXQUEUE_BUFFERS 3
+#define TXQUEUE_IDLE 0xFF
+
+struct txqueue_entry {
+    uint8_t image[MCP_TXB_IMAGE_LENGTH];
+};
+
+static struct txqueue_entry txqueue_buf[TXQUEUE_SIZE];
+static volatile uint8_t txqueue_head;
+static volatile uint8_t txqueue_tail;
+// TXP of the frame loaded in TXBn, TXQUEUE_IDLE when the buffer is free
+static uint8_t txqueue_priority[TXQUEUE_BUFFERS];
+
+static const enum TXBn txqueue_txbn[TXQUEUE_BUFFERS] = {TXB0, TXB1, TXB2};
+static const uint8_t txqueue_txif[TXQUEUE_BUFFERS] = {CANINTF_TX0IF, CANINTF_TX1IF, CANINTF_TX2IF};
+
+static void txqueue_load(void);
+
+/*
+ * Forgets the queued frames and the buffer state, for a freshly opened
+ * channel.
+ */
+void txqueue_init(void)
+{
+    uint8_t held = holdInterrupt();
+    txqueue_head = 0;
+    txqueue_tail = 0;
+    for (uint8_t i = 0; i < TXQUEUE_BUFFERS; i++) {
+        txqueue_priority[i] = TXQUEUE_IDLE;
+    }
+    releaseInterrupt(held);
+}
+
+/*
+ * Main loop side. Returns false when the queue is full or the frame is
+ * invalid. Runs with the MCP2515 interrupt held, so neither the handler
+ * nor the Timer1 tick sees a buffer that is claimed but not requested
+ * yet, or an entry that is half written.
+ */
+bool txqueue_push(const struct can_frame *frame)
+{
+    bool queued = false;
+    uint8_t held = holdInterrupt();
+    uint8_t head = txqueue_head;
+    if ((uint8_t) (head - txqueue_tail) != TXQUEUE_SIZE
+        && prepareMessage(frame, txqueue_buf[head & TXQUEUE_MASK].image) == MCP2515_ERROR_OK) {
+        txqueue_head = head + 1;
+        queued = true;
+    }
+    txqueue_load();
+    releaseInterrupt(held);
+    return queued;
+}
+
+/*
+ * For a context that holds the MCP2515: loads the cyclic frames that fell
+ * due, and whatever else waits, into free buffers. The Timer1 tick calls
+ * it when the MCP2515 is free, ISR(PCINT1_vect) before it returns.
+ */
+void txqueue_service(void)
+{
+    txqueue_load();
+}
+
+/*
+ * Called from processInterrupt() with the TXnIF bits it has cleared.
+ */
+void txqueue_transmitted(const uint8_t txif)
+{
+    for (uint8_t i = 0; i < TXQUEUE_BUFFERS; i++) {
+        if (txif & txqueue_txif[i]) {
+            txqueue_priority[i] = TXQUEUE_IDLE;
+        }
+    }
+    txqueue_load();
+}
+
+/*
+ * Called from processInterrupt() on ERRIF or MERRF with EFLG. Once the
+ * MCP2515 is error passive a frame nobody acknowledges is retried
+ * forever, and bus off holds every pending buffer until the bus recovers,
+ * so then failed buffers, all of them when bus off, are aborted and freed
+ * instead of waiting for a TXnIF. Returns the number of frames dropped.
+ */
+uint8_t txqueue_error(const uint8_t eflg)
+{
+    if (!(eflg & (EFLG_TXEP | EFLG_TXBO))) {
+        return 0;
+    }
+    uint8_t loaded = 0;
+    for (uint8_t i = 0; i < TXQUEUE_BUFFERS; i++) {
+        if (txqueue_priority[i] != TXQUEUE_IDLE) {
+            loaded |= txqueue_txif[i];
+        }
+    }
+    if (loaded == 0) {
+        return 0;
+    }
+    uint8_t aborted = abortTransmissions(loaded, !(eflg & EFLG_TXBO));
+    uint8_t dropped = 0;
+    for (uint8_t i = 0; i < TXQUEUE_BUFFERS; i++) {
+        if (aborted & txqueue_txif[i]) {
+            txqueue_priority[i] = TXQUEUE_IDLE;
+            dropped++;
+        }
+    }
+    if (dropped != 0) {
+        txqueue_load();
+    }
+    return dropped;
+}
+
+uint8_t txqueue_count(void)
+{
+    return (uint8_t) (txqueue_head - txqueue_tail);
+}
+
+bool txqueue_full(void)
+{
+    return txqueue_count() == TXQUEUE_SIZE;
+}
+
+/*
+ * Cyclic frames go first, they are stepped and encoded only once a buffer
+ * is free for them.
+ */
+static void txqueue_load(void)
+{
+    while (true) {
+        uint8_t lowest = MCP_TXB_PRIORITY_HIGHEST + 1;
+        uint8_t free = TXQUEUE_BUFFERS;
+        for (uint8_t i = 0; i < TXQUEUE_BUFFERS; i++) {
+            uint8_t priority = txqueue_priority[i];
+            if (priority == TXQUEUE_IDLE) {
+                if (free == TXQUEUE_BUFFERS) {
+                    free = i;
+                }
+            } else if (priority < lowest) {
+                lowest = priority;
+            }
+        }
+        if (free == TXQUEUE_BUFFERS || lowest == 0) {
+            return;
+        }
+        uint8_t cyclic[MCP_TXB_IMAGE_LENGTH];
+        const uint8_t *image;
+        const struct can_frame *frame = schedule_take();
+        if (frame != NULL) {
+            if (prepareMessage(frame, cyclic) != MCP2515_ERROR_OK) {
+                continue;
+            }
+            image = cyclic;
+        } else {
+            uint8_t tail = txqueue_tail;
+            if (tail == txqueue_head) {
+                return;
+            }
+            image = txqueue_buf[tail & TXQUEUE_MASK].image;
+            txqueue_tail = tail + 1;
+        }
+        txqueue_priority[free] = lowest - 1;
+        sendImageThroughTXBn(txqueue_txbn[free], image, lowest - 1);
+    }
+}
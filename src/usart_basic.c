@@ -38,16 +38,39 @@
 #include <clock_config.h>
 #include <usart_basic.h>
 #include <atomic.h>
+#include <string.h>
 
 /* Static Variables holding the ringbuffer used in IRQ mode */
-static uint8_t          USART_0_rxbuf[USART_0_RX_BUFFER_SIZE];
-static volatile uint8_t USART_0_rx_head;
-static volatile uint8_t USART_0_rx_tail;
-static volatile uint8_t USART_0_rx_elements;
-static uint8_t          USART_0_txbuf[USART_0_TX_BUFFER_SIZE];
-static volatile uint8_t USART_0_tx_head;
-static volatile uint8_t USART_0_tx_tail;
-static volatile uint8_t USART_0_tx_elements;
+/* Indices wider than 8 bit are only touched inside critical sections from the main context */
+static uint8_t                     USART_0_rxbuf[USART_0_RX_BUFFER_SIZE];
+static volatile usart_0_rx_index_t USART_0_rx_head;
+static volatile usart_0_rx_index_t USART_0_rx_tail;
+static volatile usart_0_rx_index_t USART_0_rx_elements;
+static volatile usart_0_rx_index_t USART_0_rx_high_water;
+static uint8_t                     USART_0_txbuf[USART_0_TX_BUFFER_SIZE];
+static volatile usart_0_tx_index_t USART_0_tx_head;
+static volatile usart_0_tx_index_t USART_0_tx_tail;
+static volatile usart_0_tx_index_t USART_0_tx_elements;
+static volatile usart_0_tx_index_t USART_0_tx_high_water;
+static bool                        USART_0_tx_used;
+
+static inline usart_0_rx_index_t USART_0_rx_count(void)
+{
+	usart_0_rx_index_t n;
+	ENTER_CRITICAL(C);
+	n = USART_0_rx_elements;
+	EXIT_CRITICAL(C);
+	return n;
+}
+
+static inline usart_0_tx_index_t USART_0_tx_count(void)
+{
+	usart_0_tx_index_t n;
+	ENTER_CRITICAL(C);
+	n = USART_0_tx_elements;
+	EXIT_CRITICAL(C);
+	return n;
+}
 
 void USART_0_default_rx_isr_cb(void);
 void (*USART_0_rx_isr_cb)(void) = &USART_0_default_rx_isr_cb;
@@ -56,8 +79,8 @@ void (*USART_0_udre_isr_cb)(void) = &USART_0_default_udre_isr_cb;
 
 void USART_0_default_rx_isr_cb(void)
 {
-	uint8_t data;
-	uint8_t tmphead;
+	uint8_t            data;
+	usart_0_rx_index_t tmphead;
 
 	/* Read the received data */
 	data = UDR0;
@@ -73,12 +96,15 @@ void USART_0_default_rx_isr_cb(void)
 		/* Store received data in buffer */
 		USART_0_rxbuf[tmphead] = data;
 		USART_0_rx_elements++;
+		if (USART_0_rx_elements > USART_0_rx_high_water) {
+			USART_0_rx_high_water = USART_0_rx_elements;
+		}
 	}
 }
 
 void USART_0_default_udre_isr_cb(void)
 {
-	uint8_t tmptail;
+	usart_0_tx_index_t tmptail;
 
 	/* Check if all data is transmitted */
 	if (USART_0_tx_elements != 0) {
@@ -137,12 +163,12 @@ ISR(USART0_UDRE_vect)
 
 bool USART_0_is_tx_ready()
 {
-	return (USART_0_tx_elements != USART_0_TX_BUFFER_SIZE);
+	return (USART_0_tx_count() != USART_0_TX_BUFFER_SIZE);
 }
 
 bool USART_0_is_rx_ready()
 {
-	return (USART_0_rx_elements != 0);
+	return (USART_0_rx_count() != 0);
 }
 
 bool USART_0_is_tx_busy()
@@ -159,16 +185,16 @@ bool USART_0_is_tx_busy()
  */
 uint8_t USART_0_read(void)
 {
-	uint8_t tmptail;
+	usart_0_rx_index_t tmptail;
 
 	/* Wait for incoming data */
-	while (USART_0_rx_elements == 0)
+	while (USART_0_rx_count() == 0)
 		;
 	/* Calculate buffer index */
 	tmptail = (USART_0_rx_tail + 1) & USART_0_RX_BUFFER_MASK;
+	ENTER_CRITICAL(R);
 	/* Store new index */
 	USART_0_rx_tail = tmptail;
-	ENTER_CRITICAL(R);
 	USART_0_rx_elements--;
 	EXIT_CRITICAL(R);
 
@@ -176,6 +202,43 @@ uint8_t USART_0_read(void)
 	return USART_0_rxbuf[tmptail];
 }
 
+/**
+ * \brief Read up to and including a delimiter from USART_0
+ *
+ * Copies what the RX ring holds into block, stopping after the delimiter,
+ * after size characters or when the ring is empty, and releases the
+ * copied characters with a single critical section.
+ * Function does not block.
+ *
+ * \param[out] block     Where the characters go
+ * \param[in]  size      Room in block
+ * \param[in]  delimiter Character that ends the read
+ *
+ * \return Number of characters read, the delimiter included
+ */
+uint8_t USART_0_read_until(uint8_t *block, uint8_t size, uint8_t delimiter)
+{
+	usart_0_rx_index_t available = USART_0_rx_count();
+	usart_0_rx_index_t tmptail   = USART_0_rx_tail;
+	uint8_t            n         = 0;
+
+	while (n < size && n < available) {
+		/* Only this function and USART_0_read() move the tail */
+		tmptail    = (tmptail + 1) & USART_0_RX_BUFFER_MASK;
+		block[n++] = USART_0_rxbuf[tmptail];
+		if (block[n - 1] == delimiter) {
+			break;
+		}
+	}
+	if (n != 0) {
+		ENTER_CRITICAL(R);
+		USART_0_rx_tail = tmptail;
+		USART_0_rx_elements -= n;
+		EXIT_CRITICAL(R);
+	}
+	return n;
+}
+
 /**
  * \brief Write one character to USART_0
  *
@@ -187,12 +250,12 @@ uint8_t USART_0_read(void)
  */
 void USART_0_write(const uint8_t data)
 {
-	uint8_t tmphead;
+	usart_0_tx_index_t tmphead;
 
 	/* Calculate buffer index */
 	tmphead = (USART_0_tx_head + 1) & USART_0_TX_BUFFER_MASK;
 	/* Wait for free space in buffer */
-	while (USART_0_tx_elements == USART_0_TX_BUFFER_SIZE)
+	while (USART_0_tx_count() == USART_0_TX_BUFFER_SIZE)
 		;
 	/* Store data in buffer */
 	USART_0_txbuf[tmphead] = data;
@@ -200,11 +263,150 @@ void USART_0_write(const uint8_t data)
 	USART_0_tx_head = tmphead;
 	ENTER_CRITICAL(W);
 	USART_0_tx_elements++;
+	if (USART_0_tx_elements > USART_0_tx_high_water) {
+		USART_0_tx_high_water = USART_0_tx_elements;
+	}
 	EXIT_CRITICAL(W);
+	/* Clear TXC so USART_0_flush() can tell when this byte has left */
+	UCSR0A = (UCSR0A & (1 << U2X0)) | (1 << TXC0);
+	USART_0_tx_used = true;
 	/* Enable UDRE interrupt */
 	UCSR0B |= (1 << UDRIE0);
 }
 
+/**
+ * \brief Write a block of characters to USART_0
+ *
+ * The block is copied into the TX ring with memcpy and published with a
+ * single critical section; blocks larger than the ring are split.
+ * Function will block until the data can be accepted.
+ *
+ * \param[in] block The characters to write
+ * \param[in] size  Number of characters
+ *
+ * \return Nothing
+ */
+void USART_0_write_block(const uint8_t *block, uint16_t size)
+{
+	while (size != 0) {
+		usart_0_tx_index_t chunk = (size > USART_0_TX_BUFFER_SIZE) ? USART_0_TX_BUFFER_SIZE : size;
+		usart_0_tx_index_t start;
+		usart_0_tx_index_t first;
+
+		/* Wait for free space in buffer */
+		while ((uint16_t)(USART_0_TX_BUFFER_SIZE - USART_0_tx_count()) < chunk)
+			;
+		/* Only this function and USART_0_write() move the head */
+		start = (USART_0_tx_head + 1) & USART_0_TX_BUFFER_MASK;
+		first = USART_0_TX_BUFFER_SIZE - start;
+		if (first > chunk) {
+			first = chunk;
+		}
+		memcpy(&USART_0_txbuf[start], block, first);
+		memcpy(&USART_0_txbuf[0], block + first, chunk - first);
+
+		ENTER_CRITICAL(W);
+		USART_0_tx_head = (USART_0_tx_head + chunk) & USART_0_TX_BUFFER_MASK;
+		USART_0_tx_elements += chunk;
+		if (USART_0_tx_elements > USART_0_tx_high_water) {
+			USART_0_tx_high_water = USART_0_tx_elements;
+		}
+		EXIT_CRITICAL(W);
+
+		block += chunk;
+		size -= chunk;
+
+		UCSR0A = (UCSR0A & (1 << U2X0)) | (1 << TXC0);
+		USART_0_tx_used = true;
+		/* Enable UDRE interrupt */
+		UCSR0B |= (1 << UDRIE0);
+	}
+}
+
+/**
+ * \brief Wait until everything written to USART_0 has been shifted out
+ *
+ * \return Nothing
+ */
+void USART_0_flush(void)
+{
+	while (USART_0_tx_count() != 0)
+		;
+	if (USART_0_tx_used) {
+		while (!(UCSR0A & (1 << TXC0)))
+			;
+	}
+}
+
+/**
+ * \brief Highest number of bytes waiting in the RX ring since init
+ *
+ * \return RX high-water mark
+ */
+usart_0_rx_index_t USART_0_get_rx_high_water(void)
+{
+	usart_0_rx_index_t n;
+	ENTER_CRITICAL(H);
+	n = USART_0_rx_high_water;
+	EXIT_CRITICAL(H);
+	return n;
+}
+
+/**
+ * \brief Highest number of bytes waiting in the TX ring since init
+ *
+ * Useful to size USART_0_TX_BUFFER_SIZE from field data.
+ *
+ * \return TX high-water mark
+ */
+usart_0_tx_index_t USART_0_get_tx_high_water(void)
+{
+	usart_0_tx_index_t n;
+	ENTER_CRITICAL(H);
+	n = USART_0_tx_high_water;
+	EXIT_CRITICAL(H);
+	return n;
+}
+
+/**
+ * \brief Change the USART_0 baud rate at runtime
+ *
+ * Pending TX data is sent at the old rate first. The divisor is always
+ * computed for double speed mode (U2X), which gives exact rates from
+ * 2400 up to F_CPU / 8 with the 14.7456 MHz crystal.
+ *
+ * \param[in] baud The new baud rate
+ *
+ * \return Status
+ * \retval 0 the baud rate was set
+ * \retval 1 the baud rate cannot be generated within 2% error
+ */
+int8_t USART_0_set_baudrate(const uint32_t baud)
+{
+	if (baud == 0) {
+		return 1;
+	}
+	uint32_t divisor = ((F_CPU / 8) + (baud / 2)) / baud;
+	if (divisor == 0 || divisor > 4096) {
+		return 1;
+	}
+	uint32_t actual = (F_CPU / 8) / divisor;
+	uint32_t error  = (actual > baud) ? (actual - baud) : (baud - actual);
+	if (error * 50 > baud) {
+		return 1;
+	}
+
+	USART_0_flush();
+
+	ENTER_CRITICAL(B);
+	UBRR0H = (uint8_t)((divisor - 1) >> 8);
+	UBRR0L = (uint8_t)(divisor - 1);
+	UCSR0A = 1 << U2X0;
+	EXIT_CRITICAL(B);
+
+	return 0;
+}
+
 /**
  * \brief Initialize USART interface
  * If module is configured to disabled state, the clock to the USART is disabled
@@ -222,7 +424,10 @@ int8_t USART_0_init()
 	/* Enable USART0 */
 	PRR0 &= ~(1 << PRUSART0);
 
+/* Boot baud rate, normally passed in from CMakeLists.txt */
+#ifndef BAUD
 #define BAUD 115200
+#endif
 
 #include <util/setbaud.h>
 
@@ -254,6 +459,10 @@ int8_t USART_0_init()
 	USART_0_tx_tail     = x;
 	USART_0_tx_head     = x;
 	USART_0_tx_elements = x;
+	USART_0_tx_used     = false;
+
+	USART_0_rx_high_water = x;
+	USART_0_tx_high_water = x;
 
 	return 0;
 }